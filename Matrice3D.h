@@ -11,8 +11,227 @@
 #include <ostream>
 #include <iterator>
 #include <iostream>
+#include <cassert>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include <utility>
+#include <climits>
+#include "conversion.h"
+#include "parallel.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+ @brief Bounds check policy: out of range accesses throw std::out_of_range.
+*/
+struct bounds_throw {
+    static void check(bool ok){
+        if (!ok)
+            throw std::out_of_range("Out of range");
+    }
+};
+
+/**
+ @brief Bounds check policy: out of range accesses fail an assert, no check
+ when NDEBUG is defined.
+*/
+struct bounds_assert {
+    static void check(bool ok){
+        assert(ok);
+        (void)ok;
+    }
+};
+
+/**
+ @brief Bounds check policy: no check at all, for hot loops.
+*/
+struct bounds_unchecked {
+    static void check(bool){}
+};
+
+/**
+ @brief Coordinates of an element of a Matrice3D.
+*/
+struct coord3d {
+    unsigned int x;
+    unsigned int y;
+    unsigned int z;
+};
+
+/**
+ @brief How concurrent additions to the same matrix are combined.
+
+ - atomic: every addition is an atomic read-modify-write on the matrix
+ - privatized: every thread adds into a private buffer, the buffers are
+   summed into the matrix at the end
+*/
+enum class accumulation { atomic, privatized };
+
+namespace matrice3d_detail {
+
+    /**
+     @brief out[i] = data[idx[i]], with AVX2 gather instructions for float and
+     int when available and the indices fit in a signed 32-bit integer.
+    */
+    template <typename T>
+    void gather_indices(const T* data, std::size_t count, const unsigned int* idx, T* out, std::size_t n){
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        if (count <= std::size_t(INT_MAX)){
+            if constexpr (std::is_same<T, float>::value){
+                for(; i+8<=n; i+=8){
+                    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx+i));
+                    _mm256_storeu_ps(out+i, _mm256_i32gather_ps(data, v, 4));
+                }
+            }else if constexpr (std::is_same<T, int>::value){
+                for(; i+8<=n; i+=8){
+                    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx+i));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out+i), _mm256_i32gather_epi32(data, v, 4));
+                }
+            }
+        }
+#else
+        (void)count;
+#endif
+        for(; i<n; i++)
+            out[i] = data[idx[i]];
+    }
+
+    /**
+     @brief Permutation that visits the indices in increasing order.
+    */
+    inline std::vector<std::size_t> sorted_order(const std::vector<unsigned int>& idx){
+        std::vector<std::pair<unsigned int, std::size_t>> keyed(idx.size());
+        for(std::size_t i=0; i<idx.size(); i++)
+            keyed[i] = std::make_pair(idx[i], i);
+        std::sort(keyed.begin(), keyed.end());
+        std::vector<std::size_t> order(idx.size());
+        for(std::size_t i=0; i<idx.size(); i++)
+            order[i] = keyed[i].second;
+        return order;
+    }
+
+    /**
+     @brief Copy a box of elements into a contiguous buffer, one x-run at a time.
+
+     @param src first element of the box
+     @param row_stride distance between two consecutive rows of src
+     @param plane_stride distance between two consecutive planes of src
+     @param dst contiguous destination, cols*rows*depth elements
+    */
+    template <typename T>
+    void copy_box(const T* src, std::size_t row_stride, std::size_t plane_stride,
+        T* dst, unsigned int cols, unsigned int rows, unsigned int depth){
+        std::size_t plane = std::size_t(cols) * rows;
+        std::size_t grain = std::max<std::size_t>(1, (std::size_t(1) << 16) / std::max<std::size_t>(plane, 1));
+        parallel::for_range(0, depth, grain, [=](std::size_t first, std::size_t last){
+            for(std::size_t z=first; z<last; z++){
+                for(unsigned int y=0; y<rows; y++){
+                    const T* run = src + z*plane_stride + y*row_stride;
+                    T* out = dst + z*plane + std::size_t(y)*cols;
+                    if constexpr (std::is_trivially_copyable<T>::value)
+                        std::memcpy(out, run, cols*sizeof(T));
+                    else
+                        std::copy(run, run + cols, out);
+                }
+            }
+        });
+    }
+
+}
+
+template <typename T, typename Check = bounds_throw>
+class Matrice3D;
+
+/**
+ @brief Non-owning view of a box of a Matrice3D, as returned by slice_view().
+
+ No element is copied: the view refers to the memory of the matrix, which must
+ outlive it. T is const for views of const matrices.
+*/
+template <typename T, typename Check = bounds_throw>
+class Matrice3D_view {
+private:
+    T* _origin; // element (0, 0, 0) of the view
+    unsigned int _cols;
+    unsigned int _rows;
+    unsigned int _depth;
+    std::size_t _row_stride; // elements between (x, y, z) and (x, y+1, z)
+    std::size_t _plane_stride; // elements between (x, y, z) and (x, y, z+1)
+
+public:
+    /**
+     @brief Constructor.
+
+     @param origin first element of the view
+     @param cols number of elements on the x axis
+     @param rows number of elements on the y axis
+     @param depth number of elements on the z axis
+     @param row_stride distance between two rows in the underlying matrix
+     @param plane_stride distance between two planes in the underlying matrix
+    */
+    Matrice3D_view(T* origin, unsigned int cols, unsigned int rows, unsigned int depth,
+        std::size_t row_stride, std::size_t plane_stride):
+        _origin(origin), _cols(cols), _rows(rows), _depth(depth),
+        _row_stride(row_stride), _plane_stride(plane_stride) {}
+
+    /**
+     @brief Access a value of the view.
+     
+     @param x position on x axis
+     @param y position on y axis
+     @param z position on z axis
+     
+     @return the value reference at (x, y, z) position of the view
+    */
+    T& operator()(unsigned int x, unsigned int y, unsigned int z) const{
+        Check::check(x < this->_cols && y < this->_rows && z < this->_depth);
+
+        return this->_origin[z*this->_plane_stride + y*this->_row_stride + x];
+    }
+
+    /**
+     @brief Get the contiguous run of cols() elements of row y in plane z.
+    */
+    T* row(unsigned int y, unsigned int z) const{
+        return this->_origin + z*this->_plane_stride + y*this->_row_stride;
+    }
+
+    unsigned int cols() const{
+        return this->_cols;
+    }
+
+    unsigned int rows() const{
+        return this->_rows;
+    }
+
+    unsigned int depth() const{
+        return this->_depth;
+    }
 
-template <typename T>
+    /**
+     @brief Copy the viewed elements into a new matrix.
+    */
+    Matrice3D<typename std::remove_const<T>::type, Check> to_matrix() const{
+        Matrice3D<typename std::remove_const<T>::type, Check> out(this->_cols, this->_rows, this->_depth);
+        matrice3d_detail::copy_box(static_cast<const T*>(this->_origin), this->_row_stride, this->_plane_stride,
+            out.data(), this->_cols, this->_rows, this->_depth);
+        return out;
+    }
+};
+
+/**
+ @brief 3D matrix of T, stored with the x axis contiguous in memory.
+
+ The Check policy (bounds_throw, bounds_assert or bounds_unchecked) decides
+ what operator() does with out of range coordinates; at() always throws.
+*/
+template <typename T, typename Check>
 class Matrice3D {
 private:
     unsigned int _cols; // number of elements on the x axis
@@ -39,7 +258,58 @@ private:
     }
     
     unsigned int get_index(unsigned int x, unsigned int y, unsigned int z) const{
-        return z*this->_cols*this->_rows+y*this->_rows+x;
+        return (z*this->_rows+y)*this->_cols+x;
+    }
+
+    /**
+     @brief Check a list of linear indices with the Check policy, and that
+     there is one value per index.
+
+     @throw std::invalid_argument Different number of indices and values
+    */
+    void check_indices(const std::vector<unsigned int>& indices, std::size_t values) const{
+        if (indices.size() != values)
+            throw std::invalid_argument("Different number of indices and values");
+        this->check_indices(indices);
+    }
+
+    void check_indices(const std::vector<unsigned int>& indices) const{
+        if constexpr (!std::is_same<Check, bounds_unchecked>::value){
+            std::size_t count = std::size_t(this->_cols) * this->_rows * this->_depth;
+            for(std::size_t i=0; i<indices.size(); i++)
+                Check::check(indices[i] < count);
+        }
+    }
+
+    /**
+     @brief Convert coordinates to linear indices, checked with the Check policy.
+    */
+    std::vector<unsigned int> indices_of(const std::vector<coord3d>& coords) const{
+        std::vector<unsigned int> indices(coords.size());
+        for(std::size_t i=0; i<coords.size(); i++)
+            indices[i] = this->index_of(coords[i].x, coords[i].y, coords[i].z);
+        return indices;
+    }
+
+    /**
+     @brief Check the bounds of a box given by slice coordinates.
+
+     @throw std::out_of_range Out of range
+     @throw std::invalid_argument Invalid coordinates
+    */
+    void check_box(
+        unsigned int x1, unsigned int x2,
+        unsigned int y1, unsigned int y2,
+        unsigned int z1, unsigned int z2
+    ) const{
+        if (!this->within_bounds(x2, y2, z2))
+            throw std::out_of_range("Out of range");
+        
+        if (
+            x1 > x2
+            || y1 > y2
+            || z1 > z2
+        ) throw std::invalid_argument("Invalid coordinates");
     }
 
 public:
@@ -66,6 +336,78 @@ public:
         }
     }
 
+    /**
+     @brief Copy constructor.
+
+     @param other matrix to copy
+    */
+    Matrice3D(const Matrice3D& other):
+        _cols(other._cols), _rows(other._rows), _depth(other._depth), _data(nullptr)
+    {
+        std::size_t count = std::size_t(this->_cols) * this->_rows * this->_depth;
+        if (other._data != nullptr){
+            this->_data = new T[count];
+            try {
+                std::copy(other._data, other._data + count, this->_data);
+            }catch(...){
+                delete[] this->_data;
+                throw;
+            }
+        }
+    }
+
+    /**
+     @brief Move constructor, takes the data of other without copying it.
+
+     @param other matrix to move, left without data and with zero dimensions
+    */
+    Matrice3D(Matrice3D&& other) noexcept:
+        _cols(other._cols), _rows(other._rows), _depth(other._depth), _data(other._data)
+    {
+        other._cols = other._rows = other._depth = 0;
+        other._data = nullptr;
+    }
+
+    /**
+     @brief Copy assignment.
+
+     @param other matrix to copy
+
+     @return reference to this matrix
+    */
+    Matrice3D& operator=(const Matrice3D& other){
+        if (this != &other){
+            Matrice3D tmp(other);
+            this->swap(tmp);
+        }
+        return *this;
+    }
+
+    /**
+     @brief Move assignment, takes the data of other without copying it.
+
+     @param other matrix to move, left without data and with zero dimensions
+
+     @return reference to this matrix
+    */
+    Matrice3D& operator=(Matrice3D&& other) noexcept{
+        if (this != &other){
+            Matrice3D tmp(std::move(other));
+            this->swap(tmp);
+        }
+        return *this;
+    }
+
+    /**
+     @brief Swap the content of two matrices.
+    */
+    void swap(Matrice3D& other) noexcept{
+        std::swap(this->_cols, other._cols);
+        std::swap(this->_rows, other._rows);
+        std::swap(this->_depth, other._depth);
+        std::swap(this->_data, other._data);
+    }
+
     /**
      @brief Destructor.
     */
@@ -75,13 +417,17 @@ public:
     
     /**
      @brief Convert matrix elements from T type to U type.
+
+     @param mode how the values are mapped to U (see conversion.h)
+
+     @return a new matrix of type U with the same dimensions
     */
-    template <typename U> operator U(){
-        unsigned int count = this->_cols * this->_rows * this->_depth;
-        for(unsigned int i=0; i<count; i++){
-            this->_data[i] = 
-                dynamic_cast<U>(this->data[i]);
-        }
+    template <typename U>
+    Matrice3D<U, Check> convert(conversion mode = conversion::saturate) const{
+        Matrice3D<U, Check> out(this->_cols, this->_rows, this->_depth);
+        convert_elements(this->_data, out.data(),
+            std::size_t(this->_cols) * this->_rows * this->_depth, mode);
+        return out;
     }
     
     /**
@@ -93,13 +439,12 @@ public:
      
      @return the value at (x, y, z) position
 
-     @throw std::out_of_range Out of range
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
     */
     T operator()(unsigned int x, unsigned int y, unsigned int z) const{
-        if (!this->within_bounds(x, y, z))
-            throw std::out_of_range("Out of range");
+        Check::check(this->within_bounds(x, y, z));
 
-        return *this->_data[this->get_index(x,y,z)];
+        return this->_data[this->get_index(x,y,z)];
     }
 
 
@@ -112,11 +457,44 @@ public:
      
      @return the value reference at (x, y, z) position
 
-     @throw std::out_of_range Out of range
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
     */
     T& operator()(unsigned int x, unsigned int y, unsigned int z){
-        if (!this->within_bounds(x, y, z))
-            throw std::out_of_range("Out of range");
+        Check::check(this->within_bounds(x, y, z));
+
+        return this->_data[this->get_index(x,y,z)];
+    }
+
+    /**
+     @brief Access a matrix value, checking the bounds whatever the policy.
+     
+     @param x position on x axis
+     @param y position on y axis
+     @param z position on z axis
+     
+     @return the value at (x, y, z) position
+
+     @throw std::out_of_range Out of range
+    */
+    const T& at(unsigned int x, unsigned int y, unsigned int z) const{
+        bounds_throw::check(this->within_bounds(x, y, z));
+
+        return this->_data[this->get_index(x,y,z)];
+    }
+
+    /**
+     @brief Modify a matrix value, checking the bounds whatever the policy.
+     
+     @param x position on x axis
+     @param y position on y axis
+     @param z position on z axis
+     
+     @return the value reference at (x, y, z) position
+
+     @throw std::out_of_range Out of range
+    */
+    T& at(unsigned int x, unsigned int y, unsigned int z){
+        bounds_throw::check(this->within_bounds(x, y, z));
 
         return this->_data[this->get_index(x,y,z)];
     }
@@ -128,7 +506,7 @@ public:
 
      @return a boolean indicating if the two matrices are equals.
     */
-    bool operator==(Matrice3D<T> const& other) const{
+    bool operator==(Matrice3D const& other) const{
         if (
             this->_cols != other.cols()
             || this->_rows != other.rows()
@@ -154,29 +532,219 @@ public:
      @param z2 end of the sub-matrix on the z axis
      
      @return A sliced sub-matrix.
+
+     @throw std::out_of_range Out of range
+     @throw std::invalid_argument Invalid coordinates
     */
-    Matrice3D<T> slice(
+    Matrice3D slice(
         unsigned int x1, unsigned int x2,
         unsigned int y1, unsigned int y2,
         unsigned int z1, unsigned int z2
     ) const{
-        if (!this->within_bounds(x2, y2, z2))
-            throw std::out_of_range("Out of range");
-        
-        if (
-            x1 > x2
-            || y1 > y2
-            || z1 > z2
-        ) throw std::invalid_argument("Invalid coordinates");
+        return this->slice_view(x1, x2, y1, y2, z1, z2).to_matrix();
+    }
 
-        Matrice3D<T> sub(x2-x1+1, y2-y1+1, z2-z1+1);
-        
-        unsigned int count = this->_cols * this->_rows * this->_depth;
-        for(unsigned int i=0; i<count; i++){
-            sub.data()[i] = T(this->_data[i]);
+    /**
+     @brief Get a view of a sub-matrix, without copying the elements.
+     
+     @param x1 start of the sub-matrix on the x axis
+     @param x2 end of the sub-matrix on the x axis
+     @param y1 start of the sub-matrix on the y axis
+     @param y2 end of the sub-matrix on the y axis
+     @param z1 start of the sub-matrix on the z axis
+     @param z2 end of the sub-matrix on the z axis
+     
+     @return A view of the sub-matrix, valid as long as the matrix.
+
+     @throw std::out_of_range Out of range
+     @throw std::invalid_argument Invalid coordinates
+    */
+    Matrice3D_view<T, Check> slice_view(
+        unsigned int x1, unsigned int x2,
+        unsigned int y1, unsigned int y2,
+        unsigned int z1, unsigned int z2
+    ){
+        this->check_box(x1, x2, y1, y2, z1, z2);
+        return Matrice3D_view<T, Check>(this->_data + this->get_index(x1, y1, z1),
+            x2-x1+1, y2-y1+1, z2-z1+1,
+            this->_cols, std::size_t(this->_cols) * this->_rows);
+    }
+
+    /**
+     @brief Get a read-only view of a sub-matrix, without copying the elements.
+    */
+    Matrice3D_view<const T, Check> slice_view(
+        unsigned int x1, unsigned int x2,
+        unsigned int y1, unsigned int y2,
+        unsigned int z1, unsigned int z2
+    ) const{
+        this->check_box(x1, x2, y1, y2, z1, z2);
+        return Matrice3D_view<const T, Check>(this->_data + this->get_index(x1, y1, z1),
+            x2-x1+1, y2-y1+1, z2-z1+1,
+            this->_cols, std::size_t(this->_cols) * this->_rows);
+    }
+
+    /**
+     @brief Get the linear index of an element in data().
+     
+     @param x position on x axis
+     @param y position on y axis
+     @param z position on z axis
+
+     @return the index of (x, y, z) in data()
+
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
+    */
+    unsigned int index_of(unsigned int x, unsigned int y, unsigned int z) const{
+        Check::check(this->within_bounds(x, y, z));
+
+        return this->get_index(x, y, z);
+    }
+
+    /**
+     @brief Read the elements at a list of linear indices.
+
+     @param indices linear indices, as given by index_of()
+     @param out receives the elements, in the same order as the indices
+     @param sort visit the indices in increasing order, for locality
+
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
+    */
+    void gather(const std::vector<unsigned int>& indices, std::vector<T>& out, bool sort = false) const{
+        this->check_indices(indices);
+        out.resize(indices.size());
+        if (sort){
+            std::vector<std::size_t> order = matrice3d_detail::sorted_order(indices);
+            parallel::for_range(0, order.size(), 1 << 14, [&](std::size_t first, std::size_t last){
+                for(std::size_t i=first; i<last; i++)
+                    out[order[i]] = this->_data[indices[order[i]]];
+            });
+        }else{
+            std::size_t count = std::size_t(this->_cols) * this->_rows * this->_depth;
+            parallel::for_range(0, indices.size(), 1 << 14, [&](std::size_t first, std::size_t last){
+                matrice3d_detail::gather_indices(this->_data, count, indices.data() + first,
+                    out.data() + first, last - first);
+            });
         }
-        return sub;
-    };
+    }
+
+    /**
+     @brief Read the elements at a list of coordinates.
+
+     @param coords coordinates of the elements
+     @param out receives the elements, in the same order as the coordinates
+     @param sort visit the elements in memory order, for locality
+
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
+    */
+    void gather(const std::vector<coord3d>& coords, std::vector<T>& out, bool sort = false) const{
+        this->gather(this->indices_of(coords), out, sort);
+    }
+
+    /**
+     @brief Write values at a list of linear indices.
+
+     The indices must be distinct: the writes run on many threads, and two
+     of them writing the same element is a data race, with undefined
+     behaviour. Use scatter_add() to combine the values of repeated indices.
+
+     @param indices linear indices, as given by index_of(), all different
+     @param values values to write, one per index
+     @param sort visit the indices in increasing order, for locality
+
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
+     @throw std::invalid_argument Different number of indices and values
+    */
+    void scatter(const std::vector<unsigned int>& indices, const std::vector<T>& values, bool sort = false){
+        this->check_indices(indices, values.size());
+        std::vector<std::size_t> order;
+        if (sort)
+            order = matrice3d_detail::sorted_order(indices);
+        parallel::for_range(0, indices.size(), 1 << 14, [&](std::size_t first, std::size_t last){
+            for(std::size_t i=first; i<last; i++){
+                std::size_t k = sort ? order[i] : i;
+                this->_data[indices[k]] = values[k];
+            }
+        });
+    }
+
+    /**
+     @brief Write values at a list of coordinates, which must be distinct
+     (see the scatter() on linear indices).
+
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
+     @throw std::invalid_argument Different number of coordinates and values
+    */
+    void scatter(const std::vector<coord3d>& coords, const std::vector<T>& values, bool sort = false){
+        this->scatter(this->indices_of(coords), values, sort);
+    }
+
+    /**
+     @brief Add values at a list of linear indices, from many threads.
+
+     Repeated indices accumulate all their values. With accumulation::atomic
+     the threads add directly into the matrix; with accumulation::privatized
+     each thread adds into a private zeroed copy of the matrix and the copies
+     are summed at the end, which avoids contention on few hot elements but
+     needs one matrix of memory per thread.
+
+     @param indices linear indices, as given by index_of()
+     @param values values to add, one per index
+     @param mode how the threads combine their additions
+     @param sort visit the indices in increasing order, for locality
+
+     @throw std::out_of_range Out of range (with the bounds_throw policy)
+     @throw std::invalid_argument Different number of indices and values
+    */
+    void scatter_add(const std::vector<unsigned int>& indices, const std::vector<T>& values,
+        accumulation mode = accumulation::atomic, bool sort = false){
+        static_assert(std::is_arithmetic<T>::value, "scatter_add needs an arithmetic T");
+        this->check_indices(indices, values.size());
+        std::vector<std::size_t> order;
+        if (sort)
+            order = matrice3d_detail::sorted_order(indices);
+        const std::size_t grain = 1 << 16;
+
+        if (mode == accumulation::atomic){
+            parallel::for_range(0, indices.size(), grain, [&](std::size_t first, std::size_t last){
+                for(std::size_t i=first; i<last; i++){
+                    std::size_t k = sort ? order[i] : i;
+                    parallel::atomic_add(this->_data + indices[k], values[k]);
+                }
+            });
+            return;
+        }
+
+        std::size_t count = std::size_t(this->_cols) * this->_rows * this->_depth;
+        std::size_t parts = std::max<std::size_t>(1, std::min<std::size_t>(parallel::max_threads(), indices.size() / grain));
+        std::vector<std::vector<T>> privates(parts);
+        parallel::for_range(0, parts, 1, [&](std::size_t first, std::size_t last){
+            for(std::size_t p=first; p<last; p++){
+                std::vector<T>& acc = privates[p];
+                acc.assign(count, T(0));
+                std::size_t begin = indices.size() * p / parts, end = indices.size() * (p+1) / parts;
+                for(std::size_t i=begin; i<end; i++){
+                    std::size_t k = sort ? order[i] : i;
+                    acc[indices[k]] += values[k];
+                }
+            }
+        });
+        parallel::for_range(0, count, 1 << 16, [&](std::size_t first, std::size_t last){
+            for(std::size_t p=0; p<parts; p++){
+                const T* acc = privates[p].data();
+                for(std::size_t i=first; i<last; i++)
+                    this->_data[i] += acc[i];
+            }
+        });
+    }
+
+    /**
+     @brief Add values at a list of coordinates, see scatter_add() on indices.
+    */
+    void scatter_add(const std::vector<coord3d>& coords, const std::vector<T>& values,
+        accumulation mode = accumulation::atomic, bool sort = false){
+        this->scatter_add(this->indices_of(coords), values, mode, sort);
+    }
 
     /**
      @brief Get the matrix cols.
@@ -230,7 +798,7 @@ public:
 
         unsigned int count = m.cols() * m.rows() * m.depth();
         for(unsigned int i=0; i<count; i++){
-            os << m.data()[i] << std::endl;
+            os << m.data()[i] << '\n';
         }
         return os;
     }
@@ -338,20 +906,89 @@ public:
     
 };
 
-template<typename F, typename Q, typename T>
-Matrice3D<Q> transform(Matrice3D<T> m){
-    Matrice3D<Q> out(m.cols(), m.rows(), m.depth());
-    auto m_iter = m.begin();
-    auto out_iter = out.begin();
-    F functor;
-
-    while(m_iter != m.end()){
-        *out_iter = functor(*m_iter);
-        m_iter++;
-        out_iter++;
-    }
+/**
+ @brief Apply a functor to every element, into a new matrix.
+
+ @param m source matrix
+ @param policy parallel::seq or parallel::par
+ @param functor function object called on every element
+
+ @return a matrix with the results
+*/
+template<typename F, typename Q, typename T, typename C, typename P = parallel::sequential_policy>
+Matrice3D<Q, C> transform(const Matrice3D<T, C>& m, P policy = P(), F functor = F()){
+    Matrice3D<Q, C> out(m.cols(), m.rows(), m.depth());
+    const T* in = m.data();
+    Q* result = out.data();
+    std::size_t count = std::size_t(m.cols()) * m.rows() * m.depth();
+    parallel::for_range(policy, 0, count, 1 << 16, [&](std::size_t first, std::size_t last){
+        for(std::size_t i=first; i<last; i++)
+            result[i] = functor(in[i]);
+    });
 
     return out;
 }
 
+/**
+ @brief Apply a functor to every element of a temporary matrix, reusing its
+ memory for the results.
+
+ @param m source matrix, moved into the result
+ @param policy parallel::seq or parallel::par
+ @param functor function object called on every element
+
+ @return the matrix with the results
+*/
+template<typename F, typename Q, typename T, typename C, typename P = parallel::sequential_policy,
+    typename = typename std::enable_if<std::is_same<Q, T>::value>::type>
+Matrice3D<Q, C> transform(Matrice3D<T, C>&& m, P policy = P(), F functor = F()){
+    transform_inplace(m, functor, policy);
+    return std::move(m);
+}
+
+/**
+ @brief Apply a functor to every element, replacing it with the result.
+
+ @param m matrix to transform
+ @param functor function object called on every element
+ @param policy parallel::seq or parallel::par
+*/
+template<typename F, typename T, typename C, typename P = parallel::sequential_policy>
+void transform_inplace(Matrice3D<T, C>& m, F functor, P policy = P()){
+    T* data = m.data();
+    std::size_t count = std::size_t(m.cols()) * m.rows() * m.depth();
+    parallel::for_range(policy, 0, count, 1 << 16, [&](std::size_t first, std::size_t last){
+        for(std::size_t i=first; i<last; i++)
+            data[i] = functor(data[i]);
+    });
+}
+
+/**
+ @brief Combine two matrices element by element: out = functor(a, b).
+ out may be a or b, for an in-place update.
+
+ @param a first matrix
+ @param b second matrix
+ @param out result matrix, already allocated
+ @param functor function object called as functor(a_element, b_element)
+ @param policy parallel::seq or parallel::par
+
+ @throw std::invalid_argument The dimensions do not match
+*/
+template<typename F, typename Q, typename T, typename U, typename C, typename P = parallel::sequential_policy>
+void zip_transform(const Matrice3D<T, C>& a, const Matrice3D<U, C>& b, Matrice3D<Q, C>& out,
+    F functor, P policy = P()){
+    if (a.cols() != b.cols() || a.rows() != b.rows() || a.depth() != b.depth()
+        || a.cols() != out.cols() || a.rows() != out.rows() || a.depth() != out.depth())
+        throw std::invalid_argument("Matrix dimensions do not match");
+    const T* x = a.data();
+    const U* y = b.data();
+    Q* result = out.data();
+    std::size_t count = std::size_t(a.cols()) * a.rows() * a.depth();
+    parallel::for_range(policy, 0, count, 1 << 16, [&](std::size_t first, std::size_t last){
+        for(std::size_t i=first; i<last; i++)
+            result[i] = functor(x[i], y[i]);
+    });
+}
+
 #endif
\ No newline at end of file
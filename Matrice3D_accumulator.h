@@ -0,0 +1,157 @@
+/*********************************************************************
+ * @file  Matrice3D_accumulator.h
+ * 
+ * @brief Concurrent accumulation of values into one Matrice3D.
+ *********************************************************************/
+
+#ifndef MATRICE3D_ACCUMULATOR_H
+#define MATRICE3D_ACCUMULATOR_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include "Matrice3D.h"
+#include "parallel.h"
+
+/**
+ @brief Lets many threads add values into the same matrix without locks.
+
+ Every thread gets its own handle with local() and calls add() on it.
+ With accumulation::atomic the handles add straight into the matrix with
+ atomic operations. With accumulation::privatized every handle adds into
+ private tiles of 4096 elements, allocated on first use and aligned to cache
+ lines, so threads never write the same line; merge() sums the tiles into
+ the matrix in parallel. The destructor merges what is left.
+
+ merge() and the destructor must not run while a handle is adding.
+*/
+template <typename T, typename C = bounds_throw, accumulation Mode = accumulation::atomic>
+class concurrent_accumulator {
+    static_assert(std::is_arithmetic<T>::value, "concurrent_accumulator needs an arithmetic T");
+
+public:
+    static constexpr std::size_t tile_size = 4096; // elements per private tile
+
+private:
+    struct tile_deleter {
+        void operator()(T* p) const{
+            ::operator delete(p, std::align_val_t(64));
+        }
+    };
+    typedef std::unique_ptr<T, tile_deleter> tile_ptr;
+    typedef std::vector<tile_ptr> tile_table; // one entry per tile, null until used
+
+    Matrice3D<T, C>& _m;
+    std::size_t _count; // elements of the matrix
+    std::vector<std::unique_ptr<tile_table>> _tables; // one per handle
+    std::mutex _lock; // protects _tables while handles are created
+
+public:
+    /**
+     @brief Per-thread handle, created by local().
+    */
+    class handle {
+    public:
+        /**
+         @brief Add v to the element (x, y, z).
+
+         @throw std::out_of_range Out of range (with the bounds_throw policy)
+        */
+        void add(unsigned int x, unsigned int y, unsigned int z, T v){
+            this->add_index(this->_owner->_m.index_of(x, y, z), v);
+        }
+
+        /**
+         @brief Add v to the element at a linear index, without bounds check.
+        */
+        void add_index(std::size_t i, T v){
+            if constexpr (Mode == accumulation::atomic){
+                parallel::atomic_add(this->_owner->_m.data() + i, v);
+            }else{
+                tile_ptr& tile = (*this->_table)[i / tile_size];
+                if (!tile){
+                    T* p = static_cast<T*>(::operator new(tile_size * sizeof(T), std::align_val_t(64)));
+                    std::fill(p, p + tile_size, T(0));
+                    tile.reset(p);
+                }
+                tile.get()[i % tile_size] += v;
+            }
+        }
+
+    private:
+        concurrent_accumulator* _owner;
+        tile_table* _table; // private tiles, privatized mode only
+
+        friend class concurrent_accumulator;
+
+        handle(concurrent_accumulator* owner, tile_table* table): _owner(owner), _table(table) {}
+    };
+
+    /**
+     @brief Constructor.
+
+     @param m matrix that receives the values, must outlive the accumulator
+    */
+    explicit concurrent_accumulator(Matrice3D<T, C>& m):
+        _m(m), _count(std::size_t(m.cols()) * m.rows() * m.depth()) {}
+
+    concurrent_accumulator(const concurrent_accumulator&) = delete;
+    concurrent_accumulator& operator=(const concurrent_accumulator&) = delete;
+
+    /**
+     @brief Destructor, merges the private tiles into the matrix.
+    */
+    ~concurrent_accumulator(){
+        try {
+            this->merge();
+        }
+        catch (...) {
+        }
+    }
+
+    /**
+     @brief Get a new handle for the calling thread. Handles are cheap and
+     stay valid as long as the accumulator.
+    */
+    handle local(){
+        if constexpr (Mode == accumulation::atomic){
+            return handle(this, nullptr);
+        }else{
+            std::lock_guard<std::mutex> guard(this->_lock);
+            this->_tables.emplace_back(new tile_table((this->_count + tile_size - 1) / tile_size));
+            return handle(this, this->_tables.back().get());
+        }
+    }
+
+    /**
+     @brief Sum the private tiles into the matrix and clear them, tiles split
+     among threads. Nothing to do in atomic mode.
+    */
+    void merge(){
+        if constexpr (Mode == accumulation::privatized){
+            std::size_t tiles = (this->_count + tile_size - 1) / tile_size;
+            T* data = this->_m.data();
+            parallel::for_range(0, tiles, 4, [&](std::size_t first, std::size_t last){
+                for(std::size_t t=first; t<last; t++){
+                    T* out = data + t*tile_size;
+                    std::size_t n = std::min(tile_size, this->_count - t*tile_size);
+                    for(std::size_t h=0; h<this->_tables.size(); h++){
+                        tile_ptr& tile = (*this->_tables[h])[t];
+                        if (!tile)
+                            continue;
+                        const T* in = tile.get();
+                        for(std::size_t i=0; i<n; i++)
+                            out[i] += in[i];
+                        tile.reset();
+                    }
+                }
+            });
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*********************************************************************
+ * @file  Matrice3D_gemm.h
+ * 
+ * @brief Batched matrix product over the z planes of Matrice3D.
+ *********************************************************************/
+
+#ifndef MATRICE3D_GEMM_H
+#define MATRICE3D_GEMM_H
+
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "Matrice3D.h"
+#include "parallel.h"
+
+/**
+ @brief Operation applied to an operand of gemm_batched.
+*/
+enum class gemm_op { none, transpose };
+
+namespace gemm_detail {
+
+    // register block computed by the micro-kernel
+    const unsigned int MR = 4;
+    const unsigned int NR = 16;
+    // cache blocks: an MC x KC block of A stays in L2, a KC x NR panel of B in L1
+    const unsigned int MC = 128;
+    const unsigned int KC = 256;
+    const unsigned int NC = 2048;
+
+    /**
+     @brief A plane seen as a row-major matrix, y being the row and x the column.
+    */
+    template <typename T>
+    struct operand {
+        const T* data;
+        std::size_t ld; // row stride (cols of the plane)
+        bool trans;
+
+        T at(std::size_t i, std::size_t j) const{
+            return trans ? data[j*ld + i] : data[i*ld + j];
+        }
+    };
+
+    /**
+     @brief Pack an mc x kc block of op(A) in panels of MR rows, k major,
+     padding the last panel with zeros.
+    */
+    template <typename T>
+    void pack_a(const operand<T>& a, std::size_t i0, std::size_t k0,
+        unsigned int mc, unsigned int kc, T* out){
+        for(unsigned int p=0; p<mc; p+=MR){
+            for(unsigned int k=0; k<kc; k++){
+                for(unsigned int i=0; i<MR; i++){
+                    *out++ = p+i < mc ? a.at(i0+p+i, k0+k) : T(0);
+                }
+            }
+        }
+    }
+
+    /**
+     @brief Pack a kc x nc block of op(B) in panels of NR columns, k major,
+     padding the last panel with zeros.
+    */
+    template <typename T>
+    void pack_b(const operand<T>& b, std::size_t k0, std::size_t j0,
+        unsigned int kc, unsigned int nc, T* out){
+        for(unsigned int p=0; p<nc; p+=NR){
+            for(unsigned int k=0; k<kc; k++){
+                if (!b.trans && p+NR <= nc){
+                    const T* row = b.data + (k0+k)*b.ld + j0 + p;
+                    for(unsigned int j=0; j<NR; j++)
+                        *out++ = row[j];
+                }else{
+                    for(unsigned int j=0; j<NR; j++)
+                        *out++ = p+j < nc ? b.at(k0+k, j0+p+j) : T(0);
+                }
+            }
+        }
+    }
+
+    /**
+     @brief C[MR x NR] += alpha * Apanel * Bpanel, writing only the m x n valid part.
+    */
+    template <typename T>
+    void micro_kernel(unsigned int kc, const T* __restrict a, const T* __restrict b, T alpha,
+        T* c, std::size_t ldc, unsigned int m, unsigned int n){
+        T acc[MR][NR] = {};
+        for(unsigned int k=0; k<kc; k++, a+=MR, b+=NR){
+            for(unsigned int j=0; j<NR; j++){
+                T bj = b[j];
+                acc[0][j] += a[0] * bj;
+                acc[1][j] += a[1] * bj;
+                acc[2][j] += a[2] * bj;
+                acc[3][j] += a[3] * bj;
+            }
+        }
+        if (m == MR && n == NR){
+            for(unsigned int i=0; i<MR; i++)
+                for(unsigned int j=0; j<NR; j++)
+                    c[i*ldc + j] += alpha * acc[i][j];
+        }else{
+            for(unsigned int i=0; i<m; i++)
+                for(unsigned int j=0; j<n; j++)
+                    c[i*ldc + j] += alpha * acc[i][j];
+        }
+    }
+
+}
+
+/**
+ @brief Batched matrix product: C[z] = alpha * op(A[z]) * op(B[z]) + beta * C[z]
+ for every z plane.
+
+ Each plane is a matrix with rows() rows and cols() columns, element (i, j)
+ being (x=j, y=i). The product is computed with packed, cache-blocked panels
+ and a register-blocked micro-kernel; the planes and the row blocks of C are
+ split among threads.
+
+ @param op_a operation on A
+ @param op_b operation on B
+ @param alpha scale of the product
+ @param a left operands, op(A[z]) is M x K
+ @param b right operands, op(B[z]) is K x N
+ @param beta scale of the previous content of C (0 ignores it, NaN included)
+ @param c result, M x N with the same depth as A and B
+
+ @throw std::invalid_argument The dimensions do not match
+*/
+template <typename T, typename C>
+void gemm_batched(gemm_op op_a, gemm_op op_b, T alpha,
+    const Matrice3D<T, C>& a, const Matrice3D<T, C>& b,
+    T beta, Matrice3D<T, C>& c){
+    using namespace gemm_detail;
+    bool ta = op_a == gemm_op::transpose, tb = op_b == gemm_op::transpose;
+    std::size_t M = ta ? a.cols() : a.rows();
+    std::size_t K = ta ? a.rows() : a.cols();
+    std::size_t N = tb ? b.rows() : b.cols();
+    if ((tb ? b.cols() : b.rows()) != K
+        || c.rows() != M || c.cols() != N
+        || a.depth() != c.depth() || b.depth() != c.depth())
+        throw std::invalid_argument("Matrix dimensions do not match");
+
+    std::size_t row_blocks = (M + MC - 1) / MC;
+    std::size_t tasks = row_blocks * c.depth();
+    parallel::for_range(0, tasks, 1, [&](std::size_t first, std::size_t last){
+        std::vector<T> pa(std::size_t(MC) * KC);
+        std::vector<T> pb(std::size_t(KC) * NC);
+        for(std::size_t t=first; t<last; t++){
+            std::size_t z = t / row_blocks;
+            std::size_t i0 = (t % row_blocks) * MC;
+            unsigned int mc = unsigned(std::min<std::size_t>(MC, M - i0));
+            operand<T> opa = { a.data() + z*a.rows()*a.cols(), a.cols(), ta };
+            operand<T> opb = { b.data() + z*b.rows()*b.cols(), b.cols(), tb };
+            T* cz = c.data() + z*M*N;
+
+            for(std::size_t i=i0; i<i0+mc; i++){
+                T* row = cz + i*N;
+                if (beta == T(0))
+                    std::fill(row, row + N, T(0));
+                else if (beta != T(1))
+                    for(std::size_t j=0; j<N; j++)
+                        row[j] *= beta;
+            }
+            if (alpha == T(0))
+                continue;
+
+            for(std::size_t j0=0; j0<N; j0+=NC){
+                unsigned int nc = unsigned(std::min<std::size_t>(NC, N - j0));
+                for(std::size_t k0=0; k0<K; k0+=KC){
+                    unsigned int kc = unsigned(std::min<std::size_t>(KC, K - k0));
+                    pack_b(opb, k0, j0, kc, nc, pb.data());
+                    pack_a(opa, i0, k0, mc, kc, pa.data());
+                    for(unsigned int jr=0; jr<nc; jr+=NR){
+                        for(unsigned int ir=0; ir<mc; ir+=MR){
+                            micro_kernel(kc, pa.data() + ir*kc, pb.data() + jr*kc, alpha,
+                                cz + (i0+ir)*N + j0 + jr, N,
+                                std::min(MR, mc-ir), std::min(NR, nc-jr));
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+#endif
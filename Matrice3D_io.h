@@ -0,0 +1,173 @@
+/*********************************************************************
+ * @file  Matrice3D_io.h
+ * 
+ * @brief Text import and export of Matrice3D (whitespace or CSV).
+ *********************************************************************/
+
+#ifndef MATRICE3D_IO_H
+#define MATRICE3D_IO_H
+
+#include <charconv> // std::to_chars, std::from_chars
+#include <istream>
+#include <ostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include "Matrice3D.h"
+#include "parallel.h"
+
+namespace io_detail {
+
+    inline bool is_separator(char c){
+        return c == ' ' || c == ',' || c == '\n' || c == '\r' || c == '\t' || c == ';';
+    }
+
+    inline const char* skip_separators(const char* p, const char* end){
+        while (p != end && is_separator(*p))
+            p++;
+        return p;
+    }
+
+    /**
+     @brief Parse one number at p, returning the position after it.
+
+     @throw std::invalid_argument Invalid number
+    */
+    template <typename T>
+    const char* parse(const char* p, const char* end, T& value){
+        std::from_chars_result r = std::from_chars(p, end, value);
+        if (r.ec != std::errc() || (r.ptr != end && !is_separator(*r.ptr)))
+            throw std::invalid_argument("Invalid number in matrix text");
+        return r.ptr;
+    }
+
+    /**
+     @brief Number of values in [p, end).
+    */
+    inline std::size_t count_values(const char* p, const char* end){
+        std::size_t n = 0;
+        bool in_value = false;
+        for(; p != end; p++){
+            bool sep = is_separator(*p);
+            if (!sep && !in_value)
+                n++;
+            in_value = !sep;
+        }
+        return n;
+    }
+
+}
+
+/**
+ @brief Write a matrix as text.
+
+ The first line holds cols, rows and depth; then every row of cols values
+ (x from 0 to cols-1) is written on its own line, rows of plane 0 first.
+ The numbers are formatted with std::to_chars in a large buffer that is
+ written to the stream when full.
+
+ @param os output stream
+ @param m matrix to write
+ @param sep separator between the values of a row (' ' or ',' for CSV)
+*/
+template <typename T, typename C>
+void write_text(std::ostream& os, const Matrice3D<T, C>& m, char sep = ' '){
+    static_assert(std::is_arithmetic<T>::value, "write_text needs an arithmetic T");
+    const std::size_t capacity = std::size_t(1) << 20;
+    const std::size_t room = 64; // enough for any number and its separator
+    std::vector<char> buffer(capacity);
+    char* out = buffer.data();
+    char* limit = buffer.data() + capacity - room;
+
+    out = std::to_chars(out, limit, m.cols()).ptr;
+    *out++ = sep;
+    out = std::to_chars(out, limit, m.rows()).ptr;
+    *out++ = sep;
+    out = std::to_chars(out, limit, m.depth()).ptr;
+    *out++ = '\n';
+
+    const T* data = m.data();
+    std::size_t lines = std::size_t(m.rows()) * m.depth();
+    for(std::size_t l=0; l<lines; l++){
+        const T* row = data + l*m.cols();
+        for(unsigned int x=0; x<m.cols(); x++){
+            if (out >= limit){
+                os.write(buffer.data(), out - buffer.data());
+                out = buffer.data();
+            }
+            out = std::to_chars(out, out + room, row[x]).ptr;
+            *out++ = x + 1 < m.cols() ? sep : '\n';
+        }
+    }
+    os.write(buffer.data(), out - buffer.data());
+}
+
+/**
+ @brief Read a matrix written by write_text.
+
+ Spaces, tabs, commas, semicolons and newlines are all accepted as
+ separators. The text is split in chunks that are parsed in parallel with
+ std::from_chars: a first pass counts the values of every chunk, a second
+ one parses each chunk at its offset.
+
+ @param is input stream
+
+ @return the matrix read
+
+ @throw std::invalid_argument Invalid number, or wrong number of values
+*/
+template <typename T, typename C = bounds_throw>
+Matrice3D<T, C> read_text(std::istream& is){
+    static_assert(std::is_arithmetic<T>::value, "read_text needs an arithmetic T");
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    const char* p = text.data();
+    const char* end = text.data() + text.size();
+
+    unsigned int dims[3];
+    for(int i=0; i<3; i++){
+        p = io_detail::skip_separators(p, end);
+        p = io_detail::parse(p, end, dims[i]);
+    }
+    Matrice3D<T, C> m(dims[0], dims[1], dims[2]);
+    std::size_t count = std::size_t(dims[0]) * dims[1] * dims[2];
+
+    // chunk boundaries moved forward to a separator, so no number is split
+    const std::size_t chunk = std::size_t(1) << 20;
+    std::vector<const char*> bounds(1, p);
+    while (end - bounds.back() > std::ptrdiff_t(chunk)){
+        const char* b = bounds.back() + chunk;
+        while (b != end && !io_detail::is_separator(*b))
+            b++;
+        bounds.push_back(b);
+    }
+    if (bounds.back() != end)
+        bounds.push_back(end);
+    std::size_t parts = bounds.size() - 1;
+
+    std::vector<std::size_t> offset(parts + 1, 0);
+    parallel::for_range(0, parts, 1, [&](std::size_t first, std::size_t last){
+        for(std::size_t c=first; c<last; c++)
+            offset[c+1] = io_detail::count_values(bounds[c], bounds[c+1]);
+    });
+    for(std::size_t c=0; c<parts; c++)
+        offset[c+1] += offset[c];
+    if (offset[parts] != count)
+        throw std::invalid_argument("Wrong number of values in matrix text");
+
+    T* data = m.data();
+    parallel::for_range(0, parts, 1, [&](std::size_t first, std::size_t last){
+        for(std::size_t c=first; c<last; c++){
+            const char* q = io_detail::skip_separators(bounds[c], bounds[c+1]);
+            T* out = data + offset[c];
+            while (q != bounds[c+1]){
+                q = io_detail::parse(q, bounds[c+1], *out++);
+                q = io_detail::skip_separators(q, bounds[c+1]);
+            }
+        }
+    });
+    return m;
+}
+
+#endif
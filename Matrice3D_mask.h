@@ -0,0 +1,391 @@
+/*********************************************************************
+ * @file  Matrice3D_mask.h
+ * 
+ * @brief Packed bit masks built by comparing a Matrice3D, and the
+ *        masked operations that use them.
+ *********************************************************************/
+
+#ifndef MATRICE3D_MASK_H
+#define MATRICE3D_MASK_H
+
+#include <stdexcept>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "Matrice3D.h"
+#include "parallel.h"
+
+/**
+ @brief Packed 3D bit mask, one bit per element of a Matrice3D with the same
+ dimensions. Bit i of the mask refers to data()[i] of the matrix.
+*/
+class mask3d {
+private:
+    unsigned int _cols;
+    unsigned int _rows;
+    unsigned int _depth;
+    std::vector<std::uint64_t> _words; // 64 elements per word, unused bits are zero
+
+public:
+    /**
+     @brief Constructor, all the bits are cleared.
+
+     @param cols number of elements on the x axis
+     @param rows number of elements on the y axis
+     @param depth number of elements on the z axis
+    */
+    mask3d(unsigned int cols, unsigned int rows, unsigned int depth):
+        _cols(cols), _rows(rows), _depth(depth),
+        _words((std::size_t(cols) * rows * depth + 63) / 64, 0) {}
+
+    unsigned int cols() const{
+        return this->_cols;
+    }
+
+    unsigned int rows() const{
+        return this->_rows;
+    }
+
+    unsigned int depth() const{
+        return this->_depth;
+    }
+
+    /**
+     @brief Number of elements covered by the mask.
+    */
+    std::size_t size() const{
+        return std::size_t(this->_cols) * this->_rows * this->_depth;
+    }
+
+    /**
+     @brief Get the packed words of the mask. The bits past size() in the
+     last word are zero.
+    */
+    const std::uint64_t* words() const{
+        return this->_words.data();
+    }
+
+    /**
+     @brief Replace word w of the mask. The bits past size() are dropped, so
+     the last word keeps its unused bits zero.
+    */
+    void set_word(std::size_t w, std::uint64_t bits){
+        if (w + 1 == this->_words.size() && this->size() % 64 != 0)
+            bits &= (std::uint64_t(1) << (this->size() % 64)) - 1;
+        this->_words[w] = bits;
+    }
+
+    std::size_t word_count() const{
+        return this->_words.size();
+    }
+
+    /**
+     @brief Get the bit of element (x, y, z).
+
+     @throw std::out_of_range Out of range
+    */
+    bool operator()(unsigned int x, unsigned int y, unsigned int z) const{
+        std::size_t i = this->index(x, y, z);
+        return (this->_words[i / 64] >> (i % 64)) & 1;
+    }
+
+    /**
+     @brief Set or clear the bit of element (x, y, z).
+
+     @throw std::out_of_range Out of range
+    */
+    void set(unsigned int x, unsigned int y, unsigned int z, bool value = true){
+        std::size_t i = this->index(x, y, z);
+        if (value)
+            this->_words[i / 64] |= std::uint64_t(1) << (i % 64);
+        else
+            this->_words[i / 64] &= ~(std::uint64_t(1) << (i % 64));
+    }
+
+    /**
+     @brief Number of set bits.
+    */
+    std::size_t count() const{
+        std::size_t n = 0;
+        for(std::size_t w=0; w<this->_words.size(); w++)
+            n += __builtin_popcountll(this->_words[w]);
+        return n;
+    }
+
+    mask3d operator&(const mask3d& other) const{
+        this->check_same(other);
+        mask3d out(*this);
+        for(std::size_t w=0; w<this->_words.size(); w++)
+            out._words[w] &= other._words[w];
+        return out;
+    }
+
+    mask3d operator|(const mask3d& other) const{
+        this->check_same(other);
+        mask3d out(*this);
+        for(std::size_t w=0; w<this->_words.size(); w++)
+            out._words[w] |= other._words[w];
+        return out;
+    }
+
+    mask3d operator~() const{
+        mask3d out(*this);
+        for(std::size_t w=0; w<this->_words.size(); w++)
+            out._words[w] = ~out._words[w];
+        out.clear_tail();
+        return out;
+    }
+
+    bool operator==(const mask3d& other) const{
+        return this->_cols == other._cols && this->_rows == other._rows
+            && this->_depth == other._depth && this->_words == other._words;
+    }
+
+    /**
+     @brief Clear the bits past the last element.
+    */
+    void clear_tail(){
+        std::size_t used = this->size() % 64;
+        if (used != 0)
+            this->_words.back() &= (std::uint64_t(1) << used) - 1;
+    }
+
+    /**
+     @brief Check that the mask has the given dimensions.
+
+     @throw std::invalid_argument Different dimensions
+    */
+    void check_dimensions(unsigned int cols, unsigned int rows, unsigned int depth) const{
+        if (cols != this->_cols || rows != this->_rows || depth != this->_depth)
+            throw std::invalid_argument("Mask and matrix dimensions do not match");
+    }
+
+private:
+    std::size_t index(unsigned int x, unsigned int y, unsigned int z) const{
+        if (x >= this->_cols || y >= this->_rows || z >= this->_depth)
+            throw std::out_of_range("Out of range");
+        return (std::size_t(z) * this->_rows + y) * this->_cols + x;
+    }
+
+    void check_same(const mask3d& other) const{
+        other.check_dimensions(this->_cols, this->_rows, this->_depth);
+    }
+};
+
+namespace mask_detail {
+
+    // keeps the scalar of the comparisons out of template argument deduction
+    template <typename T>
+    struct identity {
+        typedef T type;
+    };
+
+    const std::size_t grain = 1024; // words per thread at least
+
+    /**
+     @brief Build a mask setting the bits where pred(element) is true, 64
+     elements per word with a branch-free inner loop.
+    */
+    template <typename T, typename C, typename P>
+    mask3d compare(const Matrice3D<T, C>& m, P pred){
+        mask3d mask(m.cols(), m.rows(), m.depth());
+        const T* data = m.data();
+        std::size_t n = mask.size();
+        parallel::for_range(0, mask.word_count(), grain, [=, &mask](std::size_t first, std::size_t last){
+            for(std::size_t w=first; w<last; w++){
+                const T* p = data + w*64;
+                std::size_t len = n - w*64 < 64 ? n - w*64 : 64;
+                std::uint64_t bits = 0;
+                for(std::size_t j=0; j<len; j++)
+                    bits |= std::uint64_t(pred(p[j]) ? 1 : 0) << j;
+                mask.set_word(w, bits);
+            }
+        });
+        return mask;
+    }
+
+    /**
+     @brief Call f(i) for every set bit i of the words in [first, last).
+    */
+    template <typename F>
+    void for_each_bit(const std::uint64_t* words, std::size_t first, std::size_t last, F f){
+        for(std::size_t w=first; w<last; w++){
+            std::uint64_t bits = words[w];
+            while (bits != 0){
+                f(w*64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+}
+
+/**
+ @brief Comparison of every element of a matrix with a scalar.
+
+ @return a mask with the bits set where the comparison is true
+*/
+template <typename T, typename C>
+mask3d operator>(const Matrice3D<T, C>& m, const typename mask_detail::identity<T>::type& t){
+    return mask_detail::compare(m, [t](const T& v){ return v > t; });
+}
+
+template <typename T, typename C>
+mask3d operator>=(const Matrice3D<T, C>& m, const typename mask_detail::identity<T>::type& t){
+    return mask_detail::compare(m, [t](const T& v){ return v >= t; });
+}
+
+template <typename T, typename C>
+mask3d operator<(const Matrice3D<T, C>& m, const typename mask_detail::identity<T>::type& t){
+    return mask_detail::compare(m, [t](const T& v){ return v < t; });
+}
+
+template <typename T, typename C>
+mask3d operator<=(const Matrice3D<T, C>& m, const typename mask_detail::identity<T>::type& t){
+    return mask_detail::compare(m, [t](const T& v){ return v <= t; });
+}
+
+template <typename T, typename C>
+mask3d operator==(const Matrice3D<T, C>& m, const typename mask_detail::identity<T>::type& t){
+    return mask_detail::compare(m, [t](const T& v){ return v == t; });
+}
+
+template <typename T, typename C>
+mask3d operator!=(const Matrice3D<T, C>& m, const typename mask_detail::identity<T>::type& t){
+    return mask_detail::compare(m, [t](const T& v){ return v != t; });
+}
+
+/**
+ @brief Range test: bits set where lo <= element <= hi.
+*/
+template <typename T, typename C>
+mask3d in_range(const Matrice3D<T, C>& m, const typename mask_detail::identity<T>::type& lo,
+    const typename mask_detail::identity<T>::type& hi){
+    return mask_detail::compare(m, [lo, hi](const T& v){ return !(v < lo) && !(hi < v); });
+}
+
+/**
+ @brief Set the selected elements to value.
+
+ @throw std::invalid_argument Mask and matrix dimensions do not match
+*/
+template <typename T, typename C>
+void masked_fill(Matrice3D<T, C>& m, const mask3d& mask, const T& value){
+    mask.check_dimensions(m.cols(), m.rows(), m.depth());
+    T* data = m.data();
+    const std::uint64_t* words = mask.words();
+    parallel::for_range(0, mask.word_count(), mask_detail::grain, [&](std::size_t first, std::size_t last){
+        for(std::size_t w=first; w<last; w++){
+            if (words[w] == ~std::uint64_t(0)){
+                std::fill(data + w*64, data + w*64 + 64, value);
+            }else{
+                mask_detail::for_each_bit(words, w, w+1, [&](std::size_t i){ data[i] = value; });
+            }
+        }
+    });
+}
+
+/**
+ @brief Copy the selected elements of src into dst.
+
+ @throw std::invalid_argument Mask and matrix dimensions do not match
+*/
+template <typename T, typename C>
+void masked_copy(Matrice3D<T, C>& dst, const Matrice3D<T, C>& src, const mask3d& mask){
+    mask.check_dimensions(dst.cols(), dst.rows(), dst.depth());
+    mask.check_dimensions(src.cols(), src.rows(), src.depth());
+    T* out = dst.data();
+    const T* in = src.data();
+    const std::uint64_t* words = mask.words();
+    parallel::for_range(0, mask.word_count(), mask_detail::grain, [&](std::size_t first, std::size_t last){
+        for(std::size_t w=first; w<last; w++){
+            if (words[w] == ~std::uint64_t(0)){
+                std::copy(in + w*64, in + w*64 + 64, out + w*64);
+            }else{
+                mask_detail::for_each_bit(words, w, w+1, [&](std::size_t i){ out[i] = in[i]; });
+            }
+        }
+    });
+}
+
+/**
+ @brief Reduce the selected elements with an associative operation.
+
+ Each thread reduces a contiguous part of the mask starting from init, then
+ the partial results are combined in order, so init must be the identity of op.
+
+ @param m matrix
+ @param mask selected elements
+ @param init identity of op (0 for sums, 1 for products...)
+ @param op associative binary operation, called as op(accumulator, element)
+
+ @return the reduction of the selected elements
+
+ @throw std::invalid_argument Mask and matrix dimensions do not match
+*/
+template <typename R, typename T, typename C, typename Op>
+R masked_reduce(const Matrice3D<T, C>& m, const mask3d& mask, R init, Op op){
+    mask.check_dimensions(m.cols(), m.rows(), m.depth());
+    const T* data = m.data();
+    const std::uint64_t* words = mask.words();
+    std::size_t parts = std::max<std::size_t>(1,
+        std::min<std::size_t>(parallel::max_threads(), mask.word_count() / mask_detail::grain));
+    std::vector<R> partial(parts, init);
+    parallel::for_range(0, parts, 1, [&](std::size_t first, std::size_t last){
+        for(std::size_t p=first; p<last; p++){
+            R acc = init;
+            mask_detail::for_each_bit(words, mask.word_count() * p / parts, mask.word_count() * (p+1) / parts,
+                [&](std::size_t i){ acc = op(acc, data[i]); });
+            partial[p] = acc;
+        }
+    });
+    R result = partial[0];
+    for(std::size_t p=1; p<parts; p++)
+        result = op(result, partial[p]);
+    return result;
+}
+
+/**
+ @brief Sum of the selected elements.
+
+ @throw std::invalid_argument Mask and matrix dimensions do not match
+*/
+template <typename T, typename C>
+T masked_sum(const Matrice3D<T, C>& m, const mask3d& mask){
+    return masked_reduce(m, mask, T(0), [](const T& a, const T& b){ return a + b; });
+}
+
+/**
+ @brief Coordinates of the selected elements, in memory order.
+*/
+inline std::vector<coord3d> masked_coords(const mask3d& mask){
+    const std::uint64_t* words = mask.words();
+    std::size_t parts = std::max<std::size_t>(1,
+        std::min<std::size_t>(parallel::max_threads(), mask.word_count() / mask_detail::grain));
+
+    // first pass counts the bits of every part, second pass writes at the part offset
+    std::vector<std::size_t> offset(parts + 1, 0);
+    parallel::for_range(0, parts, 1, [&](std::size_t first, std::size_t last){
+        for(std::size_t p=first; p<last; p++)
+            for(std::size_t w=mask.word_count() * p / parts; w<mask.word_count() * (p+1) / parts; w++)
+                offset[p+1] += __builtin_popcountll(words[w]);
+    });
+    for(std::size_t p=0; p<parts; p++)
+        offset[p+1] += offset[p];
+
+    std::vector<coord3d> coords(offset[parts]);
+    std::size_t plane = std::size_t(mask.cols()) * mask.rows();
+    parallel::for_range(0, parts, 1, [&](std::size_t first, std::size_t last){
+        for(std::size_t p=first; p<last; p++){
+            coord3d* out = coords.data() + offset[p];
+            mask_detail::for_each_bit(words, mask.word_count() * p / parts, mask.word_count() * (p+1) / parts,
+                [&](std::size_t i){
+                    coord3d c = { unsigned(i % mask.cols()), unsigned(i % plane / mask.cols()), unsigned(i / plane) };
+                    *out++ = c;
+                });
+        }
+    });
+    return coords;
+}
+
+#endif
@@ -0,0 +1,197 @@
+/*********************************************************************
+ * @file  Matrice3D_sum.h
+ * 
+ * @brief Summed-volume table (3D integral image) of a Matrice3D.
+ *********************************************************************/
+
+#ifndef MATRICE3D_SUM_H
+#define MATRICE3D_SUM_H
+
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+#include "Matrice3D.h"
+#include "parallel.h"
+
+/**
+ @brief A box of a matrix, with inclusive bounds as in Matrice3D::slice.
+*/
+struct box3d {
+    unsigned int x1, x2;
+    unsigned int y1, y2;
+    unsigned int z1, z2;
+};
+
+/**
+ @brief Summed-volume table of a Matrice3D.
+
+ Entry (x, y, z) holds the sum of all the elements with coordinates not
+ greater than (x, y, z), so the sum of any box is obtained with 8 lookups.
+ The table is built with three scans, one per axis, each split among
+ threads. S is the type of the sums: long long for integer T, double
+ otherwise.
+*/
+template <typename T, typename S = typename std::conditional<std::is_integral<T>::value, long long, double>::type>
+class summed_volume {
+private:
+    unsigned int _cols;
+    unsigned int _rows;
+    unsigned int _depth;
+
+    // (cols+1) x (rows+1) x (depth+1) table, the first plane, row and column are zero
+    std::vector<S> _table;
+
+    std::size_t index(std::size_t x, std::size_t y, std::size_t z) const{
+        return (z*(this->_rows+1)+y)*(this->_cols+1)+x;
+    }
+
+public:
+    /**
+     @brief Build the table of a matrix.
+
+     @param m source matrix
+    */
+    template <typename C>
+    explicit summed_volume(const Matrice3D<T, C>& m):
+        _cols(m.cols()), _rows(m.rows()), _depth(m.depth()),
+        _table(std::size_t(m.cols()+1) * (m.rows()+1) * (m.depth()+1), S(0))
+    {
+        const std::size_t cx = this->_cols, cy = this->_rows, cz = this->_depth;
+        const std::size_t sx = 1, sy = cx+1, sz = (cx+1)*(cy+1);
+        S* t = this->_table.data();
+        const T* src = m.data();
+
+        // pass 1: prefix sums along x, one row per task
+        parallel::for_range(0, cy*cz, 64, [&](std::size_t first, std::size_t last){
+            for(std::size_t r=first; r<last; r++){
+                std::size_t y = r % cy, z = r / cy;
+                const T* in = src + r*cx;
+                S* out = t + (z+1)*sz + (y+1)*sy + sx;
+                S sum = S(0);
+                for(std::size_t x=0; x<cx; x++){
+                    sum += S(in[x]);
+                    out[x] = sum;
+                }
+            }
+        });
+
+        // pass 2: along y, whole rows at a time so that the inner loop is contiguous
+        parallel::for_range(1, cz+1, 1, [&](std::size_t first, std::size_t last){
+            for(std::size_t z=first; z<last; z++){
+                for(std::size_t y=2; y<=cy; y++){
+                    S* row = t + z*sz + y*sy;
+                    const S* prev = row - sy;
+                    for(std::size_t x=1; x<=cx; x++)
+                        row[x] += prev[x];
+                }
+            }
+        });
+
+        // pass 3: along z, split among threads by rows of the planes
+        parallel::for_range(1, cy+1, 1, [&](std::size_t first, std::size_t last){
+            for(std::size_t z=2; z<=cz; z++){
+                for(std::size_t y=first; y<last; y++){
+                    S* row = t + z*sz + y*sy;
+                    const S* prev = row - sz;
+                    for(std::size_t x=1; x<=cx; x++)
+                        row[x] += prev[x];
+                }
+            }
+        });
+    }
+
+    unsigned int cols() const{
+        return this->_cols;
+    }
+
+    unsigned int rows() const{
+        return this->_rows;
+    }
+
+    unsigned int depth() const{
+        return this->_depth;
+    }
+
+    /**
+     @brief Sum of the elements of a box, without bounds check.
+    */
+    S sum(const box3d& b) const{
+        const S* t = this->_table.data();
+        std::size_t x1 = b.x1, x2 = std::size_t(b.x2)+1;
+        std::size_t y1 = b.y1, y2 = std::size_t(b.y2)+1;
+        std::size_t z1 = b.z1, z2 = std::size_t(b.z2)+1;
+        return t[index(x2,y2,z2)] - t[index(x1,y2,z2)] - t[index(x2,y1,z2)] - t[index(x2,y2,z1)]
+            + t[index(x1,y1,z2)] + t[index(x1,y2,z1)] + t[index(x2,y1,z1)] - t[index(x1,y1,z1)];
+    }
+
+    /**
+     @brief Sum of the elements of a box.
+     
+     @param x1 start of the box on the x axis
+     @param x2 end of the box on the x axis
+     @param y1 start of the box on the y axis
+     @param y2 end of the box on the y axis
+     @param z1 start of the box on the z axis
+     @param z2 end of the box on the z axis
+
+     @return the sum of the elements in the box
+
+     @throw std::out_of_range Out of range
+     @throw std::invalid_argument Invalid coordinates
+    */
+    S box_sum(
+        unsigned int x1, unsigned int x2,
+        unsigned int y1, unsigned int y2,
+        unsigned int z1, unsigned int z2
+    ) const{
+        if (x2 >= this->_cols || y2 >= this->_rows || z2 >= this->_depth)
+            throw std::out_of_range("Out of range");
+        if (x1 > x2 || y1 > y2 || z1 > z2)
+            throw std::invalid_argument("Invalid coordinates");
+
+        box3d b = { x1, x2, y1, y2, z1, z2 };
+        return this->sum(b);
+    }
+
+    /**
+     @brief Mean of the elements of a box.
+
+     @throw std::out_of_range Out of range
+     @throw std::invalid_argument Invalid coordinates
+    */
+    double box_mean(
+        unsigned int x1, unsigned int x2,
+        unsigned int y1, unsigned int y2,
+        unsigned int z1, unsigned int z2
+    ) const{
+        double count = double(x2-x1+1) * (y2-y1+1) * (z2-z1+1);
+        return double(this->box_sum(x1, x2, y1, y2, z1, z2)) / count;
+    }
+
+    /**
+     @brief Sums of many boxes, split among threads.
+
+     @param boxes boxes to evaluate
+     @param out receives the sum of every box, in the same order
+
+     @throw std::out_of_range A box is out of range
+     @throw std::invalid_argument A box has invalid coordinates
+    */
+    void box_sums(const std::vector<box3d>& boxes, std::vector<S>& out) const{
+        for(std::size_t i=0; i<boxes.size(); i++){
+            const box3d& b = boxes[i];
+            if (b.x2 >= this->_cols || b.y2 >= this->_rows || b.z2 >= this->_depth)
+                throw std::out_of_range("Out of range");
+            if (b.x1 > b.x2 || b.y1 > b.y2 || b.z1 > b.z2)
+                throw std::invalid_argument("Invalid coordinates");
+        }
+        out.resize(boxes.size());
+        parallel::for_range(0, boxes.size(), 4096, [&](std::size_t first, std::size_t last){
+            for(std::size_t i=first; i<last; i++)
+                out[i] = this->sum(boxes[i]);
+        });
+    }
+};
+
+#endif
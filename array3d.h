@@ -8,6 +8,16 @@
 #include <iterator>
 #include <cstddef> 
 #include <stdexcept>
+#include <vector>
+#include <cstring> // std::memcmp
+#include <cstdint> // std::uint64_t
+#include <atomic>
+#include <type_traits>
+#include <memory> // std::allocator, std::allocator_traits
+#include <new> // placement new
+#include "conversion.h"
+#include "hash64.h"
+#include "trace.h"
 /**
   @file array3d.h
   @brief dichiarazione della classe array3d
@@ -17,23 +27,34 @@
   @brief Classe array3d
 
   Classe che vuole rappresentare una Matrice 3d di oggetti di tipo T.
+  The memory is obtained from an allocator of type A (std::allocator by
+  default, see pool_allocator.h for a pooled one).
 */
-template <typename T>
+template <typename T, typename A = std::allocator<T> >
 class array3d{
 /*public:
 	typedef unsigned int size_type;*/
 public:
 
 	typedef unsigned int size_type;
+	typedef A allocator_type;
 
 	/**
 	 @brief Default constructor
 	  rapresents a void 3d array
 	 */
-	array3d() :_DataPointer(nullptr), _rows(0), _col(0), _depth(0) {
-		#ifndef NDEBUG
-			std::cout << "array3d::array3d()" << std::endl;
-		#endif
+	array3d() :_DataPointer(nullptr), _rows(0), _col(0), _depth(0), _alloc() {
+		TRACE_EVENT("array3d", "array3d::array3d()");
+		TRACE_COUNT("array3d", constructions, 1);
+	}
+
+	/**
+	 @brief Constructor of a void 3d array that will use the given allocator
+	 @param alloc allocator used for the data
+	 */
+	explicit array3d(const A& alloc) :_DataPointer(nullptr), _rows(0), _col(0), _depth(0), _alloc(alloc) {
+		TRACE_EVENT("array3d", "array3d::array3d(const A &)");
+		TRACE_COUNT("array3d", constructions, 1);
 	}
 	/**
 	@brief secondary constructor
@@ -44,21 +65,21 @@ public:
 	@param r _rows
 	@param c _columns
 	@param d _depth
+	@param alloc allocator used for the data
 
 	@post _DataPointer != nullptr
 	@post _rows = r
 	@post _col = c
 	@post _depth = d
   */
-	explicit array3d(size_type r, size_type c, size_type d) : _DataPointer(nullptr), _rows(0), _col(0), _depth(0) {
+	explicit array3d(size_type r, size_type c, size_type d, const A& alloc = A()) : _DataPointer(nullptr), _rows(0), _col(0), _depth(0), _alloc(alloc) {
 		if (r >= 0 && c >= 0 && d >= 0) {
-			_DataPointer = new T [r * c * d];
+			_DataPointer = create(std::size_t(r) * c * d);
 			_rows = r;
 			_col = c;
 			_depth = d;
-			#ifndef NDEBUG
-				std::cout << "array3d::array3d(size_type , size_type , size_type )" << std::endl;
-			#endif
+			TRACE_EVENT("array3d", "array3d::array3d(size_type , size_type , size_type )");
+			TRACE_COUNT("array3d", constructions, 1);
 		}
 		else throw std::invalid_argument("negative dimensions are not valid!");
 	}
@@ -71,6 +92,8 @@ public:
 	@param r rows
 	@param c columns
 	@param d depth
+	@param value initial value of the elements
+	@param alloc allocator used for the data
 
 	@post _DataPointer != nullptr
 	@post rows = r
@@ -78,9 +101,9 @@ public:
 	@post depth = d
 	_DataPointer[i][j][k] = value
   */
-	array3d(size_type r, size_type c, size_type d, T value) : _DataPointer(nullptr), _rows(0), _col(0), _depth(0) {
+	array3d(size_type r, size_type c, size_type d, T value, const A& alloc = A()) : _DataPointer(nullptr), _rows(0), _col(0), _depth(0), _alloc(alloc) {
 		if (r >= 0 && c >= 0 && d >= 0) {
-			_DataPointer = new T [r * c * d];
+			_DataPointer = create(std::size_t(r) * c * d);
 					_rows = r;
 					_col = c;
 					_depth = d;
@@ -89,16 +112,15 @@ public:
 							this->_DataPointer[i] = value;
 					}
 					catch (...) {
-						delete[] _DataPointer;
+						destroy(_DataPointer, std::size_t(r) * c * d);
 						_DataPointer = nullptr;
 						_rows = 0;
 						_col = 0;
 						_depth = 0;
 						throw; // rilancio dell'eccezione !!
 					}
-					#ifndef NDEBUG
-						std::cout << "array3d::array3d(size_type , size_type , size_type , T &)" << std::endl;
-					#endif
+					TRACE_EVENT("array3d", "array3d::array3d(size_type , size_type , size_type , T &)");
+					TRACE_COUNT("array3d", constructions, 1);
 		}
 		else throw std::invalid_argument("negative dimensions are not valid!");
 	}
@@ -108,15 +130,13 @@ public:
 	the distructor deallocates the memory allocated on the head by the matrix.
   */
 	~array3d() {
-		delete[] _DataPointer;
+		destroy(_DataPointer, std::size_t(_rows) * _col * _depth);
 		_DataPointer = nullptr;
 		_rows = 0;
 		_col = 0;
 		_depth = 0;
 
-		#ifndef NDEBUG
-			std::cout << "array3d::~array3d()" << std::endl;
-		#endif
+		TRACE_EVENT("array3d", "array3d::~array3d()");
 	}
 	/**
 	@brief getters
@@ -153,8 +173,9 @@ public:
 	@post _col = other._col
 	@post _depth = other._depth
   */
-	array3d(const array3d & other) : _DataPointer(nullptr), _rows(0), _col(0), _depth(0) {
-		_DataPointer = new T [other.getRows() * other.getCol() * other.getDepth()];
+	array3d(const array3d & other) : _DataPointer(nullptr), _rows(0), _col(0), _depth(0),
+		_alloc(std::allocator_traits<A>::select_on_container_copy_construction(other._alloc)) {
+		_DataPointer = create(std::size_t(other.getRows()) * other.getCol() * other.getDepth());
 		_rows = other._rows;
 		_col = other._col;
 		_depth = other._depth;
@@ -163,22 +184,29 @@ public:
 				this->_DataPointer[i] = other._DataPointer[i];
 		}
 		catch (...) {
-			delete[] _DataPointer;
+			destroy(_DataPointer, std::size_t(_rows) * _col * _depth);
 			_DataPointer = nullptr;
 			_rows = 0;
 			_col = 0;
 			_depth = 0;
 			throw; // rilancio dell'eccezione !!
 		}
-		#ifndef NDEBUG
-			std::cout << "array3d::array3d(const array3d &)" << std::endl;
-		#endif
+		TRACE_EVENT("array3d", "array3d::array3d(const array3d &)");
+		TRACE_COUNT("array3d", copies, 1);
 	}
 	void swap(array3d & other) { //swap matrix method 
 		std::swap(this->_DataPointer, other._DataPointer);
 		std::swap(this->_rows, other._rows);
 		std::swap(this->_col, other._col);
 		std::swap(this->_depth, other._depth);
+		std::swap(this->_alloc, other._alloc);
+	}
+
+	/**
+	@brief Returns a copy of the allocator used for the data.
+	*/
+	allocator_type get_allocator() const {
+		return this->_alloc;
 	}
 	/**
 	@brief operator =
@@ -203,9 +231,7 @@ public:
 			this->swap(tmp);
 		}
 
-	#ifndef NDEBUG
-		std::cout << "array3d::operator=(const array3d &)" << std::endl;
-	#endif
+		TRACE_EVENT("array3d", "array3d::operator=(const array3d &)");
 
 		return *this;
 	}
@@ -222,10 +248,9 @@ public:
 		assert(c < _rows);
 		assert(r < _col);
 		assert(d < _depth);
-		#ifndef NDEBUG
-			std::cout << "array3d::operator()(size_type, size_type, size_type)" << std::endl;
-		#endif
-		return *this->_DataPointer[getIndexByValues(r, c, d)];
+		TRACE_EVENT("array3d", "array3d::operator()(size_type, size_type, size_type)");
+		TRACE_COUNT("array3d", accesses, 1);
+		return this->_DataPointer[getIndexByValues(r, c, d)];
 	}
 
 
@@ -233,9 +258,8 @@ public:
 		assert(c < _rows);
 		assert(r < _col);
 		assert(d < _depth);
-		#ifndef NDEBUG
-			std::cout << "array3d::operator()(size_type, size_type, size_type)" << std::endl;
-		#endif
+		TRACE_EVENT("array3d", "array3d::operator()(size_type, size_type, size_type)");
+		TRACE_COUNT("array3d", accesses, 1);
 		return this->_DataPointer[getIndexByValues(r,c,d)];
 	}
 
@@ -243,31 +267,161 @@ public:
 	@brief operator ==
 
 	The operator == returns true if the object are equal, so if they have the same content.
+	When T has a unique object representation (integers, pointers...) the memory
+	is compared with memcmp, in parallel on large arrays.
 
 	@param other matrix to compare
 	@return true if they are equal, false otherwise
 	*/
-	bool operator == (const array3d & other) {
+	bool operator == (const array3d & other) const {
 		if (this->_rows != other.getRows() || this->_col != other.getCol() || this->_depth != other.getDepth())
 			return false;
-		for (size_type i = 0; i < getRows() * getCol() * getDepth(); i++)
-			if (this->_DataPointer[i] != other.getPointer()[i])
+		std::size_t count = std::size_t(_rows) * _col * _depth;
+		if constexpr (std::has_unique_object_representations<T>::value) {
+			std::atomic<bool> equal(true);
+			const T* a = this->_DataPointer;
+			const T* b = other._DataPointer;
+			parallel::for_range(0, count, (std::size_t(1) << 20) / sizeof(T), [&](std::size_t first, std::size_t last) {
+				if (equal.load(std::memory_order_relaxed)
+					&& std::memcmp(a + first, b + first, (last - first) * sizeof(T)) != 0)
+					equal.store(false, std::memory_order_relaxed);
+			});
+			if (!equal.load())
 				return false;
-		#ifndef NDEBUG
-			std::cout << "array3d::operator==(const array3d &)" << std::endl;
-		#endif
+		}
+		else {
+			for (std::size_t i = 0; i < count; i++)
+				if (this->_DataPointer[i] != other.getPointer()[i])
+					return false;
+		}
+		TRACE_EVENT("array3d", "array3d::operator==(const array3d &)");
 		return true;
 	}
 
 	/**
-	@brief Converts a matrix from type U to a type T.
-   */
-	template <typename U>
-	operator U() {
+	@brief 64-bit hash of the content, to use as a cache or deduplication key.
+
+	The data is hashed in fixed chunks of 1MB in parallel (XXH64, see hash64.h)
+	and the chunk hashes are hashed together with the dimensions, so the result
+	does not depend on the number of threads. Equal arrays have equal hashes;
+	the bytes are hashed as stored, so 0.0 and -0.0 give different hashes.
 
-		for (size_type i = 0; i < this->_cols * this->_rows * this->_depth; i++) {
-			this->_DataPointer[i] = dynamic_cast<U>(this->_DataPointer[i]);
+	@return hash of dimensions and content
+	*/
+	std::uint64_t hash() const {
+		static_assert(std::is_trivially_copyable<T>::value, "hash() needs a trivially copyable T");
+		const std::size_t chunk = std::size_t(1) << 20;
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(this->_DataPointer);
+		std::size_t len = std::size_t(_rows) * _col * _depth * sizeof(T);
+		std::vector<std::uint64_t> hashes((len + chunk - 1) / chunk + 1);
+		parallel::for_range(0, hashes.size() - 1, 1, [&](std::size_t first, std::size_t last) {
+			for (std::size_t c = first; c < last; c++)
+				hashes[c] = hash64(bytes + c * chunk, std::min(chunk, len - c * chunk), c);
+		});
+		std::uint64_t dims[3] = { _rows, _col, _depth };
+		hashes.back() = hash64(dims, sizeof(dims));
+		return hash64(hashes.data(), hashes.size() * sizeof(std::uint64_t));
+	}
+
+	/**
+	@brief A box of elements, with coordinates given as in operator() and inclusive bounds.
+	*/
+	struct region {
+		size_type x1, x2; // first index of operator(), < getCol()
+		size_type y1, y2; // second index of operator(), < getRows()
+		size_type z1, z2; // depth
+	};
+
+	/**
+	@brief Finds the regions where two arrays differ.
+
+	The arrays are compared in blocks of 8x8x8 elements, in parallel. Adjacent
+	blocks that contain differences are joined and every group is returned as
+	the bounding box of its differing elements.
+
+	@param other array3d to compare, with the same dimensions
+	@return bounding boxes of the differing regions, empty if the arrays are equal
+
+	@throw std::invalid_argument the dimensions are different
+	*/
+	std::vector<region> diff(const array3d & other) const {
+		if (this->_rows != other.getRows() || this->_col != other.getCol() || this->_depth != other.getDepth())
+			throw std::invalid_argument("arrays of different dimensions!");
+		const size_type B = 8;
+		size_type bx = (_col + B - 1) / B, by = (_rows + B - 1) / B, bz = (_depth + B - 1) / B;
+		std::vector<region> blocks(std::size_t(bx) * by * bz);
+		std::vector<char> dirty(blocks.size(), 0);
+
+		parallel::for_range(0, bz, 1, [&](std::size_t first, std::size_t last) {
+			for (size_type kz = size_type(first); kz < last; kz++)
+				for (size_type kx = 0; kx < bx; kx++)
+					for (size_type ky = 0; ky < by; ky++) {
+						std::size_t b = (std::size_t(kz) * bx + kx) * by + ky;
+						region& r = blocks[b];
+						for (size_type z = kz * B; z < std::min(_depth, kz * B + B); z++)
+							for (size_type x = kx * B; x < std::min(_col, kx * B + B); x++)
+								for (size_type y = ky * B; y < std::min(_rows, ky * B + B); y++) {
+									size_type i = getIndexByValues(x, y, z);
+									if (this->_DataPointer[i] != other._DataPointer[i]) {
+										if (!dirty[b]) {
+											r = region{ x, x, y, y, z, z };
+											dirty[b] = 1;
+										}
+										r.x1 = std::min(r.x1, x); r.x2 = std::max(r.x2, x);
+										r.y1 = std::min(r.y1, y); r.y2 = std::max(r.y2, y);
+										r.z2 = z;
+									}
+								}
+					}
+		});
+
+		// groups of face-adjacent dirty blocks, joined with a flood fill
+		std::vector<region> result;
+		std::vector<std::size_t> todo;
+		for (std::size_t b = 0; b < blocks.size(); b++) {
+			if (dirty[b] != 1)
+				continue;
+			region box = blocks[b];
+			dirty[b] = 2;
+			todo.push_back(b);
+			while (!todo.empty()) {
+				std::size_t c = todo.back();
+				todo.pop_back();
+				const region& r = blocks[c];
+				box.x1 = std::min(box.x1, r.x1); box.x2 = std::max(box.x2, r.x2);
+				box.y1 = std::min(box.y1, r.y1); box.y2 = std::max(box.y2, r.y2);
+				box.z1 = std::min(box.z1, r.z1); box.z2 = std::max(box.z2, r.z2);
+				size_type ky = size_type(c % by), kx = size_type(c / by % bx), kz = size_type(c / by / bx);
+				std::size_t near[6] = {
+					ky > 0 ? c - 1 : c, ky + 1 < by ? c + 1 : c,
+					kx > 0 ? c - by : c, kx + 1 < bx ? c + by : c,
+					kz > 0 ? c - std::size_t(bx) * by : c, kz + 1 < bz ? c + std::size_t(bx) * by : c
+				};
+				for (int n = 0; n < 6; n++)
+					if (dirty[near[n]] == 1) {
+						dirty[near[n]] = 2;
+						todo.push_back(near[n]);
+					}
+			}
+			result.push_back(box);
 		}
+		return result;
+	}
+
+	/**
+	@brief Converts the array3d from type T to type U.
+
+	The conversion runs in parallel on large arrays, see conversion.h for the
+	available modes.
+
+	@param mode how the values are mapped to U
+	@return a new array3d<U> with the same dimensions
+   */
+	template <typename U>
+	array3d<U> convert(conversion mode = conversion::saturate) const {
+		array3d<U> result(_rows, _col, _depth);
+		convert_elements(this->_DataPointer, result.getPointer(), std::size_t(_rows) * _col * _depth, mode);
+		return result;
 	}
 
 	/**
@@ -280,13 +434,13 @@ public:
 
 	@return reference to output stream
   */
-	friend std::ostream& operator<<(std::ostream& os, const array3d<T>&m) {
+	friend std::ostream& operator<<(std::ostream& os, const array3d&m) {
 		os << "rows: " << m.getRows() << std::endl;
 		os << "columns: " << m.getCol() << std::endl;
 		os << "depth: " << m.getDepth() << std::endl;
-		for (typename array3d<T>::size_type i = 0; i < m.getDepth(); i++) {
-			for (typename array3d<T>::size_type j = 0; j < m.getRows(); j++) {
-				for (typename array3d<T>::size_type k = 0; k < m.getCol(); k++)
+		for (size_type i = 0; i < m.getDepth(); i++) {
+			for (size_type j = 0; j < m.getRows(); j++) {
+				for (size_type k = 0; k < m.getCol(); k++)
 					os << m.getPointer()[m.getIndexByValues(k, j, i)] << ' ';
 				os << std::endl;
 			}
@@ -453,14 +607,14 @@ public:
 	@param z1 start of z size
 	@param z2 end of z size
    */
-	array3d<T> slice(size_type x1, size_type x2, size_type y1, size_type y2, size_type z1, size_type z2) const {
+	array3d slice(size_type x1, size_type x2, size_type y1, size_type y2, size_type z1, size_type z2) const {
 		assert(x2 < this->_rows); // <= not considered
 		assert(y2 < this->_col);
 		assert(z2 < this->_depth);
 		assert(x1 < x2);
 		assert(y1 < y2);
 		assert(z1 < z2);
-		array3d<T> result(x2 - x1 + 1, y2 - y1 + 1, z2 - z1 + 1);
+		array3d result(x2 - x1 + 1, y2 - y1 + 1, z2 - z1 + 1, this->_alloc);
 		for(int depth = z1; depth<= z2; depth++){
 			for (int rows = y1; rows <= y2; rows++){
 				for (int col = x1; col <= x2; col++){
@@ -478,6 +632,47 @@ private:
 	size_type _rows;
 	size_type _col;
 	size_type _depth;
+	A _alloc; // allocator of the data
+
+	/**
+	* @brief allocates count elements with the allocator and default-initializes them,
+	* as new T[count] would do
+	*/
+	T* create(std::size_t count) {
+		T* p = std::allocator_traits<A>::allocate(this->_alloc, count);
+		TRACE_COUNT("array3d", allocations, 1);
+		TRACE_COUNT("array3d", bytes, count * sizeof(T));
+		if constexpr (!std::is_trivially_default_constructible<T>::value) {
+			std::size_t i = 0;
+			try {
+				for (; i < count; i++)
+					::new (static_cast<void*>(p + i)) T;
+			}
+			catch (...) {
+				destroy(p, i, count);
+				throw;
+			}
+		}
+		return p;
+	}
+
+	/**
+	* @brief destroys the first constructed elements of a block of count elements,
+	* and gives the memory back to the allocator
+	*/
+	void destroy(T* p, std::size_t constructed, std::size_t count) {
+		if (p == nullptr)
+			return;
+		if constexpr (!std::is_trivially_destructible<T>::value)
+			for (std::size_t i = 0; i < constructed; i++)
+				p[i].~T();
+		std::allocator_traits<A>::deallocate(this->_alloc, p, count);
+	}
+
+	void destroy(T* p, std::size_t count) {
+		destroy(p, count, count);
+	}
+
 	/**
 	* @brief method that returns the index of the data, by rows, clomuns and depth, using pointers logic
 	* @param r rows
@@ -491,8 +686,8 @@ private:
 	
 }; //END CLASS array3d
 
-template< typename F,typename Q, typename T >
-array3d<Q> transform (array3d<T> &m) {
+template< typename F,typename Q, typename T, typename A >
+array3d<Q> transform (array3d<T, A> &m) {
 	array3d<Q> result(m.getCol(), m.getRows(), m.getDepth());
 	auto m_iter = m.begin();
 	auto result_iter = result.begin();
@@ -0,0 +1,190 @@
+#ifndef ARRAY3D_STREAM_H
+#define ARRAY3D_STREAM_H
+
+#include <fstream> // std::ifstream, std::ofstream
+#include <future> // std::async, std::future
+#include <string>
+#include <stdexcept>
+#include <type_traits> // std::is_trivially_copyable
+#include "array3d.h"
+
+/**
+  @file array3d_stream.h
+  @brief out-of-core processing of array3d volumes stored on disk
+*/
+
+/**
+@brief Writes an array3d to a raw binary file.
+
+The elements are written as they are stored in memory, depth plane after
+depth plane, so the file can be read back by read_raw or streamed by slab_stream.
+
+@param path file to write
+@param m array3d to write
+
+@throw std::runtime_error the file cannot be written
+*/
+template <typename T>
+void write_raw(const std::string& path, const array3d<T>& m) {
+	static_assert(std::is_trivially_copyable<T>::value, "raw files need a trivially copyable T");
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(m.getPointer()),
+		std::streamsize(sizeof(T)) * m.getRows() * m.getCol() * m.getDepth());
+	if (!out)
+		throw std::runtime_error("cannot write " + path);
+}
+
+/**
+@brief Reads an array3d from a raw binary file written by write_raw.
+
+@param path file to read
+@param r rows
+@param c columns
+@param d depth
+
+@return the array3d read from the file
+
+@throw std::runtime_error the file is missing or too short
+*/
+template <typename T>
+array3d<T> read_raw(const std::string& path, typename array3d<T>::size_type r,
+	typename array3d<T>::size_type c, typename array3d<T>::size_type d) {
+	static_assert(std::is_trivially_copyable<T>::value, "raw files need a trivially copyable T");
+	array3d<T> result(r, c, d);
+	std::ifstream in(path, std::ios::binary);
+	in.read(reinterpret_cast<char*>(result.getPointer()), std::streamsize(sizeof(T)) * r * c * d);
+	if (!in)
+		throw std::runtime_error("cannot read " + path);
+	return result;
+}
+
+/**
+  @brief Classe slab_stream
+
+  Processes a raw volume that does not fit in memory one z-slab at a time.
+  Every slab is read together with `halo` extra planes on each side (fewer at
+  the borders of the volume), handed to a functor as an array3d and the
+  result slab is written to the output file. The next slab is read and the
+  previous result is written asynchronously while the functor runs, using
+  two input and two output buffers.
+*/
+template <typename T>
+class slab_stream {
+public:
+	static_assert(std::is_trivially_copyable<T>::value, "slab_stream needs a trivially copyable T");
+
+	typedef typename array3d<T>::size_type size_type;
+
+	/**
+	@brief Constructor
+
+	@param path raw file to read, written in the array3d layout
+	@param r rows of the volume
+	@param c columns of the volume
+	@param d depth of the volume
+	@param slab_depth number of planes processed by every call of the functor
+	@param halo number of neighbour planes added on each side of a slab
+
+	@throw std::invalid_argument slab_depth is zero
+  */
+	slab_stream(const std::string& path, size_type r, size_type c, size_type d,
+		size_type slab_depth, size_type halo = 0)
+		: _path(path), _rows(r), _col(c), _depth(d), _slab(slab_depth), _halo(halo) {
+		if (slab_depth == 0)
+			throw std::invalid_argument("slab depth cannot be zero!");
+	}
+
+	/**
+	@brief Runs the functor on every slab of the volume.
+
+	The functor is called as f(in, out, z, front) where `in` is the slab with
+	its halo, `out` is the array3d<Q> to fill (same rows and columns, only the
+	slab planes), `z` is the index of the first plane of `out` in the volume
+	and `front` is the number of halo planes that precede it in `in`.
+
+	@param out_path raw file that receives the result volume
+	@param functor function object applied to every slab
+
+	@throw std::runtime_error a file cannot be read or written
+  */
+	template <typename Q, typename F>
+	void process(const std::string& out_path, F functor) const {
+		static_assert(std::is_trivially_copyable<Q>::value, "slab_stream needs a trivially copyable Q");
+		std::ifstream in(_path, std::ios::binary);
+		if (!in)
+			throw std::runtime_error("cannot open " + _path);
+		std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+		if (!out)
+			throw std::runtime_error("cannot open " + out_path);
+
+		array3d<T> input[2];
+		array3d<Q> output[2];
+		std::future<void> reading;
+		std::future<void> writing;
+
+		if (_depth > 0)
+			reading = std::async(std::launch::async, [&] { load(in, input[0], 0); });
+
+		unsigned int current = 0;
+		for (size_type z = 0; z < _depth; z += _slab, current ^= 1) {
+			reading.get();
+			if (z + _slab < _depth)
+				reading = std::async(std::launch::async, [&, z, current] { load(in, input[current ^ 1], z + _slab); });
+
+			size_type planes = std::min(_slab, _depth - z);
+			if (output[current].getDepth() != planes) {
+				array3d<Q> tmp(_rows, _col, planes);
+				output[current].swap(tmp);
+			}
+			functor(static_cast<const array3d<T>&>(input[current]), output[current], z, z - first_plane(z));
+
+			if (writing.valid())
+				writing.get();
+			writing = std::async(std::launch::async, [&, current] {
+				const array3d<Q>& slab = output[current];
+				out.write(reinterpret_cast<const char*>(slab.getPointer()),
+					std::streamsize(sizeof(Q)) * _rows * _col * slab.getDepth());
+				if (!out)
+					throw std::runtime_error("cannot write slab to output file");
+			});
+		}
+		if (writing.valid())
+			writing.get();
+	}
+
+private:
+	std::string _path; // raw input file
+	size_type _rows;
+	size_type _col;
+	size_type _depth;
+	size_type _slab;  // planes per slab
+	size_type _halo;  // planes added on each side of a slab
+
+	size_type first_plane(size_type z) const {
+		return z > _halo ? z - _halo : 0;
+	}
+
+	size_type last_plane(size_type z) const { // one past the last plane read
+		size_type end = std::min(_depth, z + _slab);
+		return _depth - end > _halo ? end + _halo : _depth;
+	}
+
+	/**
+	@brief Reads the slab starting at plane z, with its halo, into buf.
+	*/
+	void load(std::ifstream& in, array3d<T>& buf, size_type z) const {
+		size_type first = first_plane(z);
+		size_type planes = last_plane(z) - first;
+		if (buf.getDepth() != planes) {
+			array3d<T> tmp(_rows, _col, planes);
+			buf.swap(tmp);
+		}
+		std::streamsize plane_bytes = std::streamsize(sizeof(T)) * _rows * _col;
+		in.seekg(plane_bytes * first);
+		in.read(reinterpret_cast<char*>(buf.getPointer()), plane_bytes * planes);
+		if (!in)
+			throw std::runtime_error("cannot read slab from " + _path);
+	}
+}; //END CLASS slab_stream
+
+#endif // !ARRAY3D_STREAM_H
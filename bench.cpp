@@ -0,0 +1,213 @@
+/**
+@file bench.cpp
+@brief benchmark dei metodi di array3d<int> e di concurrent_stack<int>
+
+Times construction, fill, element access in each axis order, iterator
+traversal, slice, transform, copy/assign and operator<< on cubes of side
+32 to 1024 (or up to the side given on the command line) and prints the
+results as JSON, one object per operation and size:
+
+	{"op": "fill", "n": 256, "elements": 16777216, "seconds": ..., "ns_per_element": ..., "gb_per_s": ...}
+
+The bytes used for GB/s are the bytes read plus the bytes written by the operation.
+
+The conversion benchmark times array3d::convert between float and uint8_t,
+uint16_t and int16_t, in both directions, on the same cubes:
+
+	{"op": "convert_float_uint8_saturate", "n": 256, "elements": 16777216, ...}
+
+The contention benchmark runs 1 to 2 * max_threads() threads that push and
+pop the same concurrent_stack<int>, with and without the elimination array:
+
+	{"op": "stack_elimination", "threads": 8, "operations": 1600000, "seconds": ..., "mops_per_s": ...}
+**/
+#include <iostream>
+#include <cstdlib> // std::atoi
+#include <chrono>
+#include <cstdint> // std::uint8_t, std::uint16_t, std::int16_t
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "array3d.h"
+#include "concurrent_stack.h"
+#include "parallel.h"
+
+typedef array3d<int> volume;
+typedef volume::size_type size_type;
+
+// stream buffer that throws away what it receives, to time operator<< alone
+class null_buffer : public std::streambuf {
+protected:
+	std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+	int overflow(int c) override { return c; }
+};
+
+struct incrementa {
+	int operator()(int v) const { return v + 1; }
+};
+
+static volatile long long sink; // keeps the results alive
+static bool first_result = true;
+
+/**
+  Runs op until at least 0.2 seconds have passed (at least once) and
+  prints the best time of a single run.
+*/
+template <typename F>
+void measure(const std::string& name, size_type n, double bytes_per_element, F op) {
+	typedef std::chrono::steady_clock clock;
+	double best = 1e300, total = 0;
+	do {
+		clock::time_point start = clock::now();
+		op();
+		double s = std::chrono::duration<double>(clock::now() - start).count();
+		best = std::min(best, s);
+		total += s;
+	} while (total < 0.2);
+
+	double elements = double(n) * n * n;
+	std::cout << (first_result ? "" : ",\n") << "  {\"op\": \"" << name << "\", \"n\": " << n
+		<< ", \"elements\": " << (long long)elements << ", \"seconds\": " << best
+		<< ", \"ns_per_element\": " << best * 1e9 / elements
+		<< ", \"gb_per_s\": " << elements * bytes_per_element / best / 1e9 << "}";
+	first_result = false;
+}
+
+void bench_size(size_type n) {
+	const double e = sizeof(int);
+	volume a(n, n, n, 1);
+	volume b(n, n, n, 2);
+
+	measure("construct", n, 0, [&] { volume v(n, n, n); sink = sink + (v.getPointer() != nullptr); });
+	measure("construct_value", n, e, [&] { volume v(n, n, n, 3); sink = sink + v.getPointer()[0]; });
+	measure("fill", n, 2 * e, [&] { b.fill(a.begin(), a.end()); });
+
+	// the second index of operator() is the contiguous one in memory
+	measure("access_x_inner", n, e, [&] {
+		long long s = 0;
+		for (size_type z = 0; z < n; z++)
+			for (size_type y = 0; y < n; y++)
+				for (size_type x = 0; x < n; x++)
+					s += a(x, y, z);
+		sink = s;
+	});
+	measure("access_y_inner", n, e, [&] {
+		long long s = 0;
+		for (size_type z = 0; z < n; z++)
+			for (size_type x = 0; x < n; x++)
+				for (size_type y = 0; y < n; y++)
+					s += a(x, y, z);
+		sink = s;
+	});
+	measure("access_z_inner", n, e, [&] {
+		long long s = 0;
+		for (size_type y = 0; y < n; y++)
+			for (size_type x = 0; x < n; x++)
+				for (size_type z = 0; z < n; z++)
+					s += a(x, y, z);
+		sink = s;
+	});
+	measure("iterator", n, e, [&] {
+		long long s = 0;
+		for (volume::iterator i = a.begin(); i != a.end(); ++i)
+			s += *i;
+		sink = s;
+	});
+	// half of the side along each axis: 1/8 of the elements are read and written
+	measure("slice", n, 2 * e / 8, [&] {
+		volume s = a.slice(n / 4, n / 4 + n / 2 - 1, n / 4, n / 4 + n / 2 - 1, n / 4, n / 4 + n / 2 - 1);
+		sink = sink + s.getPointer()[0];
+	});
+	measure("transform", n, 2 * e, [&] {
+		volume t = transform<incrementa, int>(a);
+		sink = sink + t.getPointer()[0];
+	});
+	measure("copy", n, 2 * e, [&] { volume c(a); sink = sink + c.getPointer()[0]; });
+	measure("assign", n, 2 * e, [&] { b = a; });
+
+	null_buffer buffer;
+	std::ostream out(&buffer);
+	measure("stream_out", n, e, [&] { out << a; });
+}
+
+/**
+  Converts a float cube to U and back with the given mode.
+*/
+template <typename U>
+void bench_convert_pair(const array3d<float>& f, size_type n, const std::string& type, conversion mode, const std::string& mode_name) {
+	const double e = sizeof(float) + sizeof(U);
+	array3d<U> u = f.template convert<U>(mode);
+	measure("convert_float_" + type + "_" + mode_name, n, e, [&] {
+		array3d<U> r = f.template convert<U>(mode);
+		sink = sink + r.getPointer()[0];
+	});
+	measure("convert_" + type + "_float_" + mode_name, n, e, [&] {
+		array3d<float> r = u.template convert<float>(mode);
+		sink = sink + (long long)r.getPointer()[0];
+	});
+}
+
+void bench_convert(size_type n) {
+	array3d<float> f(n, n, n);
+	float* p = f.getPointer();
+	for (std::size_t i = 0; i < std::size_t(n) * n * n; i++)
+		p[i] = float(int(i % 1024) - 300) * 0.37f; // out of range values too
+	bench_convert_pair<std::uint8_t>(f, n, "uint8", conversion::saturate, "saturate");
+	bench_convert_pair<std::uint16_t>(f, n, "uint16", conversion::round, "round");
+	bench_convert_pair<std::int16_t>(f, n, "int16", conversion::round, "round");
+	bench_convert_pair<std::uint8_t>(f, n, "uint8", conversion::normalize, "normalize");
+	bench_convert_pair<std::int16_t>(f, n, "int16", conversion::normalize, "normalize");
+}
+
+/**
+  Every thread pushes and pops a concurrent_stack<int> shared by all of
+  them, in bursts of four pushes and four pops. Prints the best of three runs.
+*/
+template <contention M>
+void bench_stack(const std::string& name, unsigned int threads) {
+	const unsigned int per_thread = 200000;
+	double best = 1e300;
+	for (int run = 0; run < 3; run++) {
+		concurrent_stack<int, M> s;
+		std::vector<std::thread> t;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < threads; i++)
+			t.emplace_back([&s, per_thread] {
+				long long sum = 0;
+				int v;
+				for (unsigned int k = 0; k < per_thread; k += 8) {
+					for (int j = 0; j < 4; j++)
+						s.push(int(k) + j);
+					for (int j = 0; j < 4; j++)
+						if (s.try_pop(v))
+							sum += v;
+				}
+				sink = sink + sum;
+			});
+		for (std::size_t i = 0; i < t.size(); i++)
+			t[i].join();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	double operations = double(threads) * per_thread;
+	std::cout << (first_result ? "" : ",\n") << "  {\"op\": \"" << name << "\", \"threads\": " << threads
+		<< ", \"operations\": " << (long long)operations << ", \"seconds\": " << best
+		<< ", \"mops_per_s\": " << operations / best / 1e6 << "}";
+	first_result = false;
+}
+
+int main(int argc, char* argv[]) {
+	size_type max_side = argc > 1 ? size_type(std::atoi(argv[1])) : 1024;
+	std::cout << "[\n";
+	for (size_type n = 32; n <= max_side; n *= 2)
+		bench_size(n);
+	for (size_type n = 32; n <= max_side; n *= 2)
+		bench_convert(n);
+	for (unsigned int t = 1; t <= 2 * parallel::max_threads(); t *= 2) {
+		bench_stack<contention::cas>("stack_cas", t);
+		bench_stack<contention::elimination>("stack_elimination", t);
+	}
+	std::cout << "\n]" << std::endl;
+	return 0;
+}
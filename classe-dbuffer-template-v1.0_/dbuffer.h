@@ -5,6 +5,7 @@
 #include <cassert> 
 #include <iterator> // std::forward_iterator_tag
 #include <cstddef>  // std::ptrdiff_t
+#include "../trace.h"
 
 /**
   @file dbuffer.h
@@ -40,9 +41,8 @@ public:
   // Sono eseguiti prima di qualunque operazione interna al 
   // costruttore.
   
-  #ifndef NDEBUG
-  std::cout << "dbuffer::dbuffer()" << std::endl;
-  #endif
+  TRACE_EVENT("dbuffer", "dbuffer::dbuffer()");
+  TRACE_COUNT("dbuffer", constructions, 1);
 }
 
   /**
@@ -58,11 +58,12 @@ public:
   */
   explicit dbuffer(size_type sz) : _buffer(nullptr), _size(0) {
   _buffer = new value_type[sz];
+  TRACE_COUNT("dbuffer", allocations, 1);
+  TRACE_COUNT("dbuffer", bytes, sz * sizeof(value_type));
   _size = sz;
   
-  #ifndef NDEBUG
-  std::cout << "dbuffer::dbuffer(size_type)" << std::endl;
-  #endif
+  TRACE_EVENT("dbuffer", "dbuffer::dbuffer(size_type)");
+  TRACE_COUNT("dbuffer", constructions, 1);
 }
 
   /**
@@ -81,6 +82,8 @@ public:
   dbuffer(size_type sz, const value_type &value) : _buffer(nullptr), _size(0) {
 
   _buffer = new value_type[sz];
+  TRACE_COUNT("dbuffer", allocations, 1);
+  TRACE_COUNT("dbuffer", bytes, sz * sizeof(value_type));
   _size = sz;
 
   try {
@@ -95,9 +98,8 @@ public:
     throw; // rilancio dell'eccezione !!
   }
 
-  #ifndef NDEBUG
-  std::cout << "dbuffer::dbuffer(size_type, value_type)" << std::endl;
-  #endif
+  TRACE_EVENT("dbuffer", "dbuffer::dbuffer(size_type, value_type)");
+  TRACE_COUNT("dbuffer", constructions, 1);
 }
 
   /**
@@ -113,9 +115,7 @@ public:
   _buffer = nullptr;
   _size = 0;
 
-  #ifndef NDEBUG
-  std::cout << "dbuffer::~dbuffer()"<< std::endl;
-  #endif
+  TRACE_EVENT("dbuffer", "dbuffer::~dbuffer()");
 }
 
   /**
@@ -132,6 +132,8 @@ public:
   */
   dbuffer(const dbuffer &other) : _buffer(nullptr), _size(0) {
   _buffer = new value_type[other._size];
+  TRACE_COUNT("dbuffer", allocations, 1);
+  TRACE_COUNT("dbuffer", bytes, other._size * sizeof(value_type));
   _size = other._size;
   try {
     for(size_type i=0; i<_size; ++i)
@@ -143,9 +145,8 @@ public:
     _size =0;
     throw;
   }
-  #ifndef NDEBUG
-  std::cout << "dbuffer::dbuffer(const dbuffer&)"<< std::endl;
-  #endif
+  TRACE_EVENT("dbuffer", "dbuffer::dbuffer(const dbuffer&)");
+  TRACE_COUNT("dbuffer", copies, 1);
 }
 
   /**
@@ -171,9 +172,7 @@ public:
     this->swap(tmp);
   }
 
-  #ifndef NDEBUG
-  std::cout << "dbuffer::operator=(const dbuffer &)" << std::endl;
-  #endif
+  TRACE_EVENT("dbuffer", "dbuffer::operator=(const dbuffer &)");
 
   return *this;
 }
@@ -0,0 +1,418 @@
+#ifndef CONCURRENT_STACK_H
+#define CONCURRENT_STACK_H
+
+#include <algorithm> // std::sort, std::binary_search
+#include <atomic>
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t, std::uint32_t
+#include <mutex>
+#include <stdexcept>
+#include <thread> // std::thread::id
+#include <utility> // std::move
+#include <vector>
+
+/**
+  @file concurrent_stack.h
+  @brief lock-free stack shared by many threads (Treiber stack with hazard pointers)
+*/
+
+namespace concurrent_detail {
+
+	/**
+	@brief Hazard pointer of one thread. A thread publishes here the node it
+	is about to dereference; a retired node is deleted only when no record
+	points to it.
+	*/
+	struct hazard_record {
+		std::atomic<std::thread::id> owner;
+		std::atomic<void*> pointer;
+
+		hazard_record() : owner(std::thread::id()), pointer(nullptr) {}
+	};
+
+	constexpr unsigned int max_hazard_pointers = 128; // threads using the stacks at the same time
+
+	inline hazard_record* hazard_records() {
+		static hazard_record records[max_hazard_pointers];
+		return records;
+	}
+
+	/**
+	@brief Owns a hazard_record for the lifetime of a thread.
+	*/
+	class hazard_owner {
+	public:
+		hazard_owner() : _record(nullptr) {
+			hazard_record* records = hazard_records();
+			for (unsigned int i = 0; i < max_hazard_pointers; i++) {
+				std::thread::id none;
+				if (records[i].owner.compare_exchange_strong(none, std::this_thread::get_id())) {
+					_record = records + i;
+					return;
+				}
+			}
+			throw std::runtime_error("too many threads use hazard pointers!");
+		}
+
+		~hazard_owner() {
+			_record->pointer.store(nullptr, std::memory_order_release);
+			_record->owner.store(std::thread::id(), std::memory_order_release);
+		}
+
+		std::atomic<void*>& pointer() {
+			return _record->pointer;
+		}
+
+	private:
+		hazard_record* _record;
+	};
+
+	/**
+	@brief The hazard pointer of the calling thread.
+	*/
+	inline std::atomic<void*>& hazard_pointer() {
+		thread_local hazard_owner owner;
+		return owner.pointer();
+	}
+
+	/**
+	@brief A node removed from a structure, waiting to be deleted.
+	*/
+	struct retired_node {
+		void* pointer;
+		void (*deleter)(void*);
+	};
+
+	/**
+	@brief Nodes left by the threads that exited before they could delete
+	them. The lock is taken only at thread exit and when a scan adopts them.
+	*/
+	struct orphan_list {
+		std::mutex lock;
+		std::vector<retired_node> nodes;
+		std::atomic<bool> pending;
+
+		orphan_list() : pending(false) {}
+	};
+
+	inline orphan_list& orphans() {
+		static orphan_list list;
+		return list;
+	}
+
+	/**
+	@brief Deletes the nodes of list that are not protected by a hazard
+	pointer and keeps the others.
+	*/
+	inline void scan(std::vector<retired_node>& list) {
+		orphan_list& o = orphans();
+		if (o.pending.load(std::memory_order_acquire) && o.lock.try_lock()) {
+			list.insert(list.end(), o.nodes.begin(), o.nodes.end());
+			o.nodes.clear();
+			o.pending.store(false, std::memory_order_release);
+			o.lock.unlock();
+		}
+
+		std::vector<void*> hazards;
+		hazard_record* records = hazard_records();
+		for (unsigned int i = 0; i < max_hazard_pointers; i++) {
+			void* p = records[i].pointer.load(std::memory_order_seq_cst);
+			if (p != nullptr)
+				hazards.push_back(p);
+		}
+		std::sort(hazards.begin(), hazards.end());
+
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < list.size(); i++) {
+			if (std::binary_search(hazards.begin(), hazards.end(), list[i].pointer))
+				list[kept++] = list[i];
+			else
+				list[i].deleter(list[i].pointer);
+		}
+		list.resize(kept);
+	}
+
+	/**
+	@brief Nodes retired by one thread. What is still protected when the
+	thread exits goes to the orphan list.
+	*/
+	struct retired_list {
+		std::vector<retired_node> nodes;
+
+		~retired_list() {
+			scan(nodes);
+			if (!nodes.empty()) {
+				orphan_list& o = orphans();
+				std::lock_guard<std::mutex> guard(o.lock);
+				o.nodes.insert(o.nodes.end(), nodes.begin(), nodes.end());
+				o.pending.store(true, std::memory_order_release);
+			}
+		}
+	};
+
+	/**
+	@brief Hands a node to the reclamation scheme: it is deleted with
+	deleter once no hazard pointer refers to it. The scan runs every
+	2 * max_hazard_pointers retirements, so its cost is amortized O(1).
+	*/
+	inline void retire(void* p, void (*deleter)(void*)) {
+		thread_local retired_list retired;
+		retired.nodes.push_back(retired_node{ p, deleter });
+		if (retired.nodes.size() >= 2 * max_hazard_pointers)
+			scan(retired.nodes);
+	}
+
+	/**
+	@brief Per-thread xorshift generator used to pick elimination slots.
+	*/
+	inline std::uint32_t next_random() {
+		thread_local std::uint32_t state = std::uint32_t(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1u;
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+} // namespace concurrent_detail
+
+/**
+  @brief How concurrent_stack handles a failed CAS on its head.
+
+  - cas: retries on the head at once;
+  - elimination: tries to meet an opposite operation in the elimination
+  array first. A push and a pop that meet there exchange the element
+  without touching the head, so under heavy contention most pairs never
+  reach it.
+*/
+enum class contention { cas, elimination };
+
+/**
+  @brief Classe concurrent_stack
+
+  Lock-free LIFO (Treiber stack) that any number of threads can use at the
+  same time. push and try_pop change the head with a single CAS. A popping
+  thread protects the head with its hazard pointer before reading it, so a
+  node cannot be deleted, nor its address reused by a new push, while the
+  CAS may still compare against it: this rules out both use-after-free and
+  the ABA problem without tagged pointers.
+
+  With contention::elimination a push whose CAS fails offers its node in a
+  random slot of the elimination array and waits a little for a pop; a
+  pop whose CAS fails looks for an offer in a random slot. The range of
+  slots used by a thread adapts: it widens when the slot picked is busy
+  and narrows when nobody shows up.
+*/
+template <typename T, contention Mode = contention::cas>
+class concurrent_stack {
+public:
+	typedef std::size_t size_type;
+
+	static constexpr unsigned int elimination_slots = 16;
+	static constexpr unsigned int elimination_wait = 256; // polls of a pusher waiting in a slot
+
+	concurrent_stack() : _head(nullptr), _size(0) {
+		for (unsigned int i = 0; i < sizeof(_slots) / sizeof(_slots[0]); i++)
+			_slots[i].offer.store(nullptr, std::memory_order_relaxed);
+	}
+
+	/**
+	@brief Distructor
+
+	Deletes the elements still in the stack. No other thread may use the
+	stack any more.
+	*/
+	~concurrent_stack() {
+		node* n = _head.load(std::memory_order_acquire);
+		while (n != nullptr) {
+			node* next = n->next;
+			delete n;
+			n = next;
+		}
+	}
+
+	concurrent_stack(const concurrent_stack&) = delete;
+	concurrent_stack& operator=(const concurrent_stack&) = delete;
+
+	/**
+	@brief Pushes a copy of value.
+
+	@param value the item to push
+	*/
+	void push(const T& value) {
+		link(new node(value));
+	}
+
+	/**
+	@brief Pushes value, moving it.
+
+	@param value the item to push
+	*/
+	void push(T&& value) {
+		link(new node(std::move(value)));
+	}
+
+	/**
+	@brief Removes the top element, if any.
+
+	@param out receives the top element
+	@return true if an element was removed, false if the stack was empty
+	*/
+	bool try_pop(T& out) {
+		std::atomic<void*>& hazard = concurrent_detail::hazard_pointer();
+		node* old = _head.load(std::memory_order_acquire);
+		for (;;) {
+			node* seen;
+			do { // the head must still be old once the hazard pointer is visible
+				seen = old;
+				hazard.store(seen, std::memory_order_seq_cst);
+				old = _head.load(std::memory_order_seq_cst);
+			} while (old != seen);
+			if (old == nullptr)
+				break;
+			if (_head.compare_exchange_strong(old, old->next, std::memory_order_acquire, std::memory_order_acquire))
+				break;
+			if (Mode == contention::elimination) {
+				hazard.store(nullptr, std::memory_order_release);
+				node* n = take_offer();
+				if (n != nullptr) {
+					out = std::move(n->value);
+					delete n; // the pusher no longer refers to it
+					return true;
+				}
+			}
+		}
+		hazard.store(nullptr, std::memory_order_release);
+		if (old == nullptr)
+			return false;
+
+		_size.fetch_sub(1, std::memory_order_relaxed);
+		out = std::move(old->value);
+		concurrent_detail::retire(old, &delete_node);
+		return true;
+	}
+
+	/**
+	@brief Number of elements, exact only when no other thread is using the stack.
+	*/
+	size_type size_approx() const {
+		std::ptrdiff_t n = _size.load(std::memory_order_relaxed);
+		return n < 0 ? 0 : size_type(n);
+	}
+
+private:
+	struct node {
+		T value;
+		node* next;
+
+		template <typename V>
+		explicit node(V&& v) : value(std::forward<V>(v)), next(nullptr) {}
+	};
+
+	/**
+	@brief Slot of the elimination array: empty (nullptr), the node offered
+	by a waiting pusher, or taken() once a pop has claimed that node. Only
+	the pusher that made the offer empties the slot again.
+	*/
+	struct alignas(64) slot {
+		std::atomic<node*> offer;
+	};
+
+	std::atomic<node*> _head;
+	std::atomic<std::ptrdiff_t> _size; // pushes minus pops, may be briefly negative
+	slot _slots[Mode == contention::elimination ? elimination_slots : 1];
+
+	static node* taken() {
+		return reinterpret_cast<node*>(std::uintptr_t(1));
+	}
+
+	/**
+	@brief Number of slots used by the calling thread, between 1 and elimination_slots.
+	*/
+	static unsigned int& range() {
+		thread_local unsigned int r = 1;
+		return r;
+	}
+
+	static void widen() {
+		unsigned int& r = range();
+		if (r < elimination_slots)
+			r *= 2;
+	}
+
+	static void narrow() {
+		unsigned int& r = range();
+		if (r > 1)
+			r /= 2;
+	}
+
+	slot& random_slot() {
+		return _slots[concurrent_detail::next_random() % range()];
+	}
+
+	void link(node* n) {
+		n->next = _head.load(std::memory_order_relaxed);
+		if (Mode == contention::elimination) {
+			while (!_head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed))
+				if (offer(n))
+					return;
+		}
+		else {
+			while (!_head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed))
+				;
+		}
+		_size.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	@brief Offers n in a random slot and waits for a pop to take it.
+
+	@return true if a pop took the node, which then belongs to the pop;
+	false if the offer was withdrawn and n must go to the head
+	*/
+	bool offer(node* n) {
+		slot& s = random_slot();
+		node* empty = nullptr;
+		if (!s.offer.compare_exchange_strong(empty, n, std::memory_order_release, std::memory_order_relaxed)) {
+			widen();
+			return false;
+		}
+		for (unsigned int i = 0; i < elimination_wait; i++) {
+			if (s.offer.load(std::memory_order_acquire) == taken()) {
+				s.offer.store(nullptr, std::memory_order_release);
+				return true;
+			}
+		}
+		node* mine = n;
+		if (s.offer.compare_exchange_strong(mine, nullptr, std::memory_order_relaxed, std::memory_order_relaxed)) {
+			narrow();
+			return false;
+		}
+		s.offer.store(nullptr, std::memory_order_release); // taken while withdrawing
+		return true;
+	}
+
+	/**
+	@brief Claims the node offered in a random slot, if any.
+
+	@return the node, now owned by the caller, or nullptr
+	*/
+	node* take_offer() {
+		slot& s = random_slot();
+		node* n = s.offer.load(std::memory_order_relaxed);
+		if (n == nullptr || n == taken()) {
+			narrow();
+			return nullptr;
+		}
+		if (!s.offer.compare_exchange_strong(n, taken(), std::memory_order_acquire, std::memory_order_relaxed)) {
+			widen();
+			return nullptr;
+		}
+		return n;
+	}
+
+	static void delete_node(void* p) {
+		delete static_cast<node*>(p);
+	}
+}; //END CLASS concurrent_stack
+
+#endif // !CONCURRENT_STACK_H
@@ -0,0 +1,159 @@
+#ifndef CONVERSION_H
+#define CONVERSION_H
+
+#include <algorithm> // std::min, std::max
+#include <cmath> // std::copysign
+#include <limits> // std::numeric_limits
+#include <type_traits>
+#include <cstddef> // std::size_t
+#include "parallel.h"
+
+/**
+  @file conversion.h
+  @brief element type conversion kernels used by array3d and Matrice3D
+*/
+
+/**
+  @brief How the values are mapped when converting from T to U.
+
+  - cast: plain static_cast, out of range values are undefined for integers
+  - saturate: values are clamped to the range of U and truncated toward zero
+  - round: like saturate, but rounded to the nearest integer (halves away from zero)
+  - normalize: integers are mapped to [0, 1] (or [-1, 1] when signed) and back,
+    scaling the full range of T onto the full range of U
+*/
+enum class conversion { cast, saturate, round, normalize };
+
+namespace conversion_detail {
+
+	// 2^digits of an integer type, exactly representable in the floating type F
+	template <typename U, typename F>
+	constexpr F range_end() {
+		return F(std::numeric_limits<U>::max() / 2 + 1) * F(2);
+	}
+
+	// largest value of F that converts to U without overflow
+	template <typename U, typename F>
+	constexpr F largest_below_range_end() {
+		return std::numeric_limits<U>::digits <= std::numeric_limits<F>::digits
+			? F(std::numeric_limits<U>::max())
+			: range_end<U, F>() * (F(1) - std::numeric_limits<F>::epsilon() / F(2));
+	}
+
+	// floating point value to integer, clamped to the range of U. Written with
+	// selects only, no early return, so that the loops calling it vectorize.
+	template <typename U, typename F>
+	inline U clamp_to_integer(F v) {
+		// std::max(lo, v) yields lo for NaN, so the conversion below is always defined
+		F c = std::min(std::max(F(std::numeric_limits<U>::lowest()), v), largest_below_range_end<U, F>());
+		U r = static_cast<U>(c);
+		if (std::numeric_limits<U>::digits > std::numeric_limits<F>::digits)
+			r = v >= range_end<U, F>() ? std::numeric_limits<U>::max() : r;
+		return v == v ? r : U(0);
+	}
+
+	// integer to integer, clamped to the range of U
+	template <typename U, typename T>
+	inline U clamp_integer(T v) {
+		if constexpr (std::numeric_limits<T>::is_signed && !std::numeric_limits<U>::is_signed)
+			v = std::max(v, T(0));
+		if constexpr (std::numeric_limits<T>::is_signed && std::numeric_limits<U>::is_signed
+			&& std::numeric_limits<T>::digits > std::numeric_limits<U>::digits)
+			v = std::max(v, T(std::numeric_limits<U>::lowest()));
+		if constexpr (std::numeric_limits<T>::digits > std::numeric_limits<U>::digits)
+			v = std::min(v, T(std::numeric_limits<U>::max()));
+		return static_cast<U>(v);
+	}
+
+	// adds +-0.5 before truncation; copysign instead of a branch, which the
+	// compiler cannot turn into a select because v - 0.5 may trap
+	template <typename F>
+	inline F round_half_away(F v) {
+		return v + std::copysign(F(0.5), v);
+	}
+
+	template <typename U, typename T, conversion M>
+	struct kernel {
+		static U apply(T v) {
+			if constexpr (M == conversion::cast || !std::is_arithmetic<T>::value || !std::is_arithmetic<U>::value) {
+				return static_cast<U>(v);
+			}
+			else if constexpr (M == conversion::normalize && !(std::is_floating_point<T>::value && std::is_floating_point<U>::value)) {
+				if constexpr (std::is_integral<T>::value && std::is_floating_point<U>::value) {
+					U r = U(v) * (U(1) / U(std::numeric_limits<T>::max()));
+					return r < U(-1) ? U(-1) : r;
+				}
+				else {
+					// integer result: go through [-1, 1] in a type wide enough for U
+					typedef typename std::conditional<
+						std::is_floating_point<T>::value && std::numeric_limits<T>::digits >= std::numeric_limits<U>::digits,
+						T, double>::type W;
+					W x = std::is_integral<T>::value ? W(v) / W(std::numeric_limits<T>::max()) : W(v);
+					W lo = std::numeric_limits<U>::is_signed ? W(-1) : W(0);
+					// clamp last: the compiler duplicates what follows a clamp into its
+					// branches, and cannot vectorize branches holding floating point math
+					W m = W(std::numeric_limits<U>::max());
+					U r = clamp_to_integer<U>(std::max(lo * m, round_half_away(x * m))); // NaN becomes lo * m
+					return v == v ? r : U(0);
+				}
+			}
+			else if constexpr (std::is_floating_point<T>::value && std::is_integral<U>::value) {
+				return clamp_to_integer<U>(M == conversion::round ? round_half_away(v) : v);
+			}
+			else if constexpr (std::is_integral<T>::value && std::is_integral<U>::value) {
+				return clamp_integer<U>(v);
+			}
+			else if constexpr (std::is_floating_point<T>::value && std::is_floating_point<U>::value
+				&& std::numeric_limits<T>::max_exponent > std::numeric_limits<U>::max_exponent) {
+				U r = static_cast<U>(std::min(std::max(T(std::numeric_limits<U>::lowest()), v), T(std::numeric_limits<U>::max())));
+				return v == v ? r : static_cast<U>(v); // NaN stays NaN
+			}
+			else {
+				return static_cast<U>(v);
+			}
+		}
+	};
+
+	// branch-free loop over raw pointers, vectorized by the compiler for the arithmetic pairs
+	template <typename U, typename T, conversion M>
+	void run_range(const T* __restrict src, U* __restrict dst, std::size_t n) {
+		for (std::size_t i = 0; i < n; i++)
+			dst[i] = kernel<U, T, M>::apply(src[i]);
+	}
+
+	template <typename U, typename T, conversion M>
+	void run(const T* __restrict src, U* __restrict dst, std::size_t n) {
+		parallel::for_range(0, n, std::size_t(1) << 16, [src, dst](std::size_t first, std::size_t last) {
+			run_range<U, T, M>(src + first, dst + first, last - first); // the captures lose __restrict
+		});
+	}
+
+} // namespace conversion_detail
+
+/**
+@brief Converts n elements from T to U with the given mode.
+
+@param src source elements
+@param dst destination elements, must not overlap src
+@param n number of elements
+@param mode conversion mode
+*/
+template <typename U, typename T>
+void convert_elements(const T* src, U* dst, std::size_t n, conversion mode) {
+	switch (mode) {
+	case conversion::cast:
+		conversion_detail::run<U, T, conversion::cast>(src, dst, n);
+		break;
+	case conversion::saturate:
+		conversion_detail::run<U, T, conversion::saturate>(src, dst, n);
+		break;
+	case conversion::round:
+		conversion_detail::run<U, T, conversion::round>(src, dst, n);
+		break;
+	case conversion::normalize:
+		conversion_detail::run<U, T, conversion::normalize>(src, dst, n);
+		break;
+	}
+}
+
+#endif // !CONVERSION_H
@@ -4,7 +4,29 @@
 **/
 #include <iostream>
 #include <fstream>
+#include <cstdio>    // std::remove
+#include <cstring>   // std::memset
+#include <limits>    // std::numeric_limits
+#include <new>       // std::bad_alloc
 #include "array3d.h" // array3d<int>
+#include "array3d_stream.h" // slab_stream<int>
+#include "pool_allocator.h" // pool_allocator<int>
+#include "Matrice3D.h" // Matrice3D<int>
+#include "Matrice3D_gemm.h" // gemm_batched
+#include "Matrice3D_sum.h" // summed_volume<int>
+#include "Matrice3D_mask.h" // mask3d
+#include "Matrice3D_io.h" // write_text, read_text
+#include "Matrice3D_accumulator.h" // concurrent_accumulator
+#include "stack.h" // stack<int>
+#include "concurrent_stack.h" // concurrent_stack<int>
+#include "work_stealing_deque.h" // work_stealing_deque<int>
+#include "small_stack.h" // small_stack<int, 4>
+#include "segmented_stack.h" // segmented_stack<int, 64>
+#include "scratch_arena.h" // scratch_arena
+#include "trace.h" // trace::dump_chrome_json
+#include <sstream>
+#include <memory>
+#include <thread>
 #include <cassert>   // assert
 
 void test_fondamentali_int() {
@@ -97,6 +119,105 @@ void test_conversione_tipo_int() {
 	array3d<int>::size_type s; // uso dei typedef
 }
 
+void test_convert() {
+	std::cout << "*** TEST convert<U>() ***" << std::endl;
+	float values[8] = { -10.5f, 0.4f, 0.5f, 1.6f, 254.5f, 300.0f, 0.25f, 1.0f };
+	array3d<float> f(2, 2, 2);
+	f.fill(values, values + 8);
+
+	unsigned char saturate[8] = { 0, 0, 0, 1, 254, 255, 0, 1 };
+	unsigned char round[8] = { 0, 0, 1, 2, 255, 255, 0, 1 };
+	unsigned char normalize[8] = { 0, 102, 128, 255, 255, 255, 64, 255 };
+	array3d<unsigned char> s = f.convert<unsigned char>();
+	array3d<unsigned char> r = f.convert<unsigned char>(conversion::round);
+	array3d<unsigned char> n = f.convert<unsigned char>(conversion::normalize);
+	for (unsigned int i = 0; i < 8; i++) {
+		assert(s.getPointer()[i] == saturate[i]);
+		assert(r.getPointer()[i] == round[i]);
+		assert(n.getPointer()[i] == normalize[i]);
+	}
+
+	int big[2] = { 70000, -70000 };
+	array3d<int> b(1, 1, 2);
+	b.fill(big, big + 2);
+	array3d<short> bs = b.convert<short>();
+	assert(bs.getPointer()[0] == 32767 && bs.getPointer()[1] == -32768);
+
+	array3d<float> nf = bs.convert<float>(conversion::normalize);
+	assert(nf.getPointer()[0] == 1.0f && nf.getPointer()[1] == -1.0f);
+}
+
+void test_confronto_int() {
+	std::cout << "*** TEST operator==, hash(), diff() ***" << std::endl;
+	array3d<int> a(20, 20, 20, 7);
+	array3d<int> b(a);
+	assert(a == b);
+	assert(a.hash() == b.hash());
+	assert(a.diff(b).empty());
+	assert(array3d<int>(20, 20, 10, 7).hash() != array3d<int>(20, 10, 20, 7).hash());
+
+	b(1, 2, 3) = 0;
+	b(2, 2, 3) = 0;
+	b(18, 19, 17) = 0;
+	assert(!(a == b));
+	assert(a.hash() != b.hash());
+	std::vector<array3d<int>::region> d = a.diff(b);
+	assert(d.size() == 2);
+	assert(d[0].x1 == 1 && d[0].x2 == 2 && d[0].y1 == 2 && d[0].y2 == 2 && d[0].z1 == 3 && d[0].z2 == 3);
+	assert(d[1].x1 == 18 && d[1].x2 == 18 && d[1].y1 == 19 && d[1].z1 == 17);
+
+	array3d<double> f(3, 3, 3, 0.5);
+	array3d<double> g(3, 3, 3, 0.5);
+	assert(f == g);
+}
+
+void test_pool_allocator_int() {
+	std::cout << "*** TEST array3d<int, pool_allocator<int> > ***" << std::endl;
+	typedef array3d<int, pool_allocator<int> > patch;
+	size_class_pool pool(1 << 16);
+	{
+		patch volume(6, 6, 6, 3, pool_allocator<int>(pool));
+		volume(1, 1, 1) = 5;
+		for (int i = 0; i < 50; i++) {
+			patch p = volume.slice(0, 1, 0, 1, 0, 1);
+			assert(p.get_allocator() == volume.get_allocator());
+			assert(p(1, 1, 1) == 5 && p(0, 0, 0) == 3);
+		}
+		patch copy(volume);
+		assert(copy == volume);
+	}
+	std::size_t used = pool.capacity();
+	assert(used > 0);
+	pool.reset();
+	patch again(6, 6, 6, 0, pool_allocator<int>(pool));
+	assert(pool.capacity() == used);
+	again(5, 5, 5) = 1;
+
+	// reset() con un contenitore ancora vivo: il blocco non torna nella free list
+	size_class_pool vivi(1 << 16);
+	patch* vecchio = new patch(4, 4, 4, 1, pool_allocator<int>(vivi));
+	vivi.reset();
+	patch nuovo(4, 4, 4, 2, pool_allocator<int>(vivi));
+	assert(nuovo.get_allocator() != vecchio->get_allocator());
+	delete vecchio; // deallocazione ignorata: il blocco e' di una generazione precedente
+	patch terzo(4, 4, 4, 3, pool_allocator<int>(vivi));
+	assert(terzo.getPointer() != nuovo.getPointer());
+	assert(nuovo(3, 3, 3) == 2 && terzo(3, 3, 3) == 3);
+
+	// un allocatore creato prima di reset() ricicla i blocchi allocati dopo
+	size_class_pool ciclo(1 << 16);
+	pool_allocator<int> prima(ciclo);
+	pool_allocator<int> copia = std::allocator_traits<pool_allocator<int> >::select_on_container_copy_construction(prima);
+	prima.deallocate(prima.allocate(256), 256);
+	ciclo.reset();
+	std::size_t capacita = ciclo.capacity();
+	for (int i = 0; i < 1000; i++) {
+		prima.deallocate(prima.allocate(256), 256);
+		copia.deallocate(copia.allocate(256), 256);
+	}
+	assert(ciclo.capacity() == capacita);
+}
+
 void test_iteratori_int() {
 	array3d<int> a(3, 3, 3, 0);
 	array3d<int> b(3, 3, 3, 0);
@@ -117,6 +238,340 @@ void test_iteratori_int() {
 	assert(a(0, 0, 0) == 100);
 }
 
+/**
+  somma dei piani vicini lungo z, calcolata slab per slab
+*/
+struct somma_piani_vicini {
+	void operator()(const array3d<int>& in, array3d<int>& out,
+		array3d<int>::size_type z, array3d<int>::size_type front) const {
+		for (unsigned int d = 0; d < out.getDepth(); d++)
+			for (unsigned int j = 0; j < out.getCol(); j++)
+				for (unsigned int k = 0; k < out.getRows(); k++) {
+					unsigned int c = d + front;
+					int sum = in(j, k, c);
+					if (c > 0) sum += in(j, k, c - 1);
+					if (c + 1 < in.getDepth()) sum += in(j, k, c + 1);
+					out(j, k, d) = sum;
+				}
+	}
+};
+
+void test_slab_stream_int() {
+	std::cout << "*** TEST slab_stream<int> ***" << std::endl;
+	array3d<int> v(4, 3, 10);
+	int count = 0;
+	for (array3d<int>::iterator i = v.begin(); i != v.end(); ++i)
+		*i = count++;
+	write_raw("slab_in.raw", v);
+
+	slab_stream<int> s("slab_in.raw", 4, 3, 10, 3, 1);
+	s.process<int>("slab_out.raw", somma_piani_vicini());
+
+	array3d<int> r = read_raw<int>("slab_out.raw", 4, 3, 10);
+	for (unsigned int d = 0; d < 10; d++)
+		for (unsigned int j = 0; j < 3; j++)
+			for (unsigned int k = 0; k < 4; k++) {
+				int sum = v(j, k, d);
+				if (d > 0) sum += v(j, k, d - 1);
+				if (d < 9) sum += v(j, k, d + 1);
+				assert(r(j, k, d) == sum);
+			}
+	std::remove("slab_in.raw");
+	std::remove("slab_out.raw");
+}
+
+void test_matrice3d_accesso() {
+	std::cout << "*** TEST Matrice3D operator() e at() ***" << std::endl;
+	Matrice3D<int> m(3, 2, 2);
+	int count = 0;
+	for (unsigned int z = 0; z < 2; z++)
+		for (unsigned int y = 0; y < 2; y++)
+			for (unsigned int x = 0; x < 3; x++)
+				m(x, y, z) = count++;
+	for (int i = 0; i < 12; i++)
+		assert(m.data()[i] == i); // x contiguo in memoria
+	assert(m.at(2, 1, 1) == 11);
+
+	bool thrown = false;
+	try { m(3, 0, 0); }
+	catch (std::out_of_range&) { thrown = true; }
+	assert(thrown);
+
+	Matrice3D<int, bounds_unchecked> u(3, 2, 2);
+	u(2, 1, 1) = 5;
+	assert(u(2, 1, 1) == 5);
+	thrown = false;
+	try { u.at(0, 2, 0); }
+	catch (std::out_of_range&) { thrown = true; }
+	assert(thrown);
+}
+
+void test_matrice3d_slice() {
+	std::cout << "*** TEST Matrice3D slice() e slice_view() ***" << std::endl;
+	Matrice3D<int> m(5, 4, 3);
+	for (unsigned int z = 0; z < 3; z++)
+		for (unsigned int y = 0; y < 4; y++)
+			for (unsigned int x = 0; x < 5; x++)
+				m(x, y, z) = 100 * z + 10 * y + x;
+
+	Matrice3D<int> s = m.slice(1, 3, 2, 3, 1, 2);
+	assert(s.cols() == 3 && s.rows() == 2 && s.depth() == 2);
+	for (unsigned int z = 0; z < 2; z++)
+		for (unsigned int y = 0; y < 2; y++)
+			for (unsigned int x = 0; x < 3; x++)
+				assert(s(x, y, z) == m(x + 1, y + 2, z + 1));
+
+	Matrice3D_view<int> v = m.slice_view(1, 3, 2, 3, 1, 2);
+	v(0, 0, 0) = -1;
+	assert(m(1, 2, 1) == -1);
+	assert(v.row(1, 1)[2] == m(3, 3, 2));
+
+	const Matrice3D<int>& c = m;
+	Matrice3D<int> copia = c.slice_view(0, 4, 0, 3, 0, 2).to_matrix();
+	assert(copia == m);
+}
+
+void test_gemm_batched() {
+	std::cout << "*** TEST gemm_batched ***" << std::endl;
+	const unsigned int M = 37, K = 300, N = 19, D = 3;
+	Matrice3D<double> a(M, K, D); // trasposta: op(A) e' M x K
+	Matrice3D<double> b(N, K, D);
+	Matrice3D<double> c(N, M, D);
+	for (unsigned int i = 0; i < M * K * D; i++) a.data()[i] = (i % 7) - 3;
+	for (unsigned int i = 0; i < K * N * D; i++) b.data()[i] = (i % 5) * 0.5;
+	for (unsigned int i = 0; i < M * N * D; i++) c.data()[i] = 1;
+
+	gemm_batched(gemm_op::transpose, gemm_op::none, 2.0, a, b, 3.0, c);
+	for (unsigned int z = 0; z < D; z++)
+		for (unsigned int i = 0; i < M; i++)
+			for (unsigned int j = 0; j < N; j++) {
+				double sum = 0;
+				for (unsigned int k = 0; k < K; k++)
+					sum += a(i, k, z) * b(j, k, z);
+				assert(c(j, i, z) == 2.0 * sum + 3.0);
+			}
+
+	// B trasposta: op(B) e' K x N, con A sia normale sia trasposta
+	Matrice3D<double> an(K, M, D);
+	Matrice3D<double> bt(K, N, D);
+	for (unsigned int i = 0; i < M * K * D; i++) an.data()[i] = a.data()[i];
+	for (unsigned int i = 0; i < K * N * D; i++) bt.data()[i] = (i % 9) - 4.5;
+	for (int ta = 0; ta < 2; ta++) {
+		for (unsigned int i = 0; i < M * N * D; i++) c.data()[i] = 1;
+		if (ta)
+			gemm_batched(gemm_op::transpose, gemm_op::transpose, 2.0, a, bt, 3.0, c);
+		else
+			gemm_batched(gemm_op::none, gemm_op::transpose, 2.0, an, bt, 3.0, c);
+		for (unsigned int z = 0; z < D; z++)
+			for (unsigned int i = 0; i < M; i++)
+				for (unsigned int j = 0; j < N; j++) {
+					double sum = 0;
+					for (unsigned int k = 0; k < K; k++)
+						sum += (ta ? a(i, k, z) : an(k, i, z)) * bt(k, j, z);
+					assert(c(j, i, z) == 2.0 * sum + 3.0);
+				}
+	}
+
+	bool thrown = false;
+	try { gemm_batched(gemm_op::none, gemm_op::none, 1.0, a, b, 0.0, c); }
+	catch (std::invalid_argument&) { thrown = true; }
+	assert(thrown);
+}
+
+void test_summed_volume() {
+	std::cout << "*** TEST summed_volume ***" << std::endl;
+	Matrice3D<int> m(6, 5, 4);
+	for (unsigned int i = 0; i < 6 * 5 * 4; i++)
+		m.data()[i] = (i * 7) % 11 - 5;
+	summed_volume<int> s(m);
+
+	std::vector<box3d> boxes;
+	for (unsigned int x1 = 0; x1 < 6; x1 += 2)
+		for (unsigned int y1 = 0; y1 < 5; y1 += 2)
+			for (unsigned int z1 = 0; z1 < 4; z1++) {
+				box3d b = { x1, 5, y1, 4, z1, z1 + (3 - z1) / 2 };
+				boxes.push_back(b);
+			}
+	std::vector<long long> sums;
+	s.box_sums(boxes, sums);
+	for (std::size_t i = 0; i < boxes.size(); i++) {
+		const box3d& b = boxes[i];
+		long long sum = 0;
+		for (unsigned int z = b.z1; z <= b.z2; z++)
+			for (unsigned int y = b.y1; y <= b.y2; y++)
+				for (unsigned int x = b.x1; x <= b.x2; x++)
+					sum += m(x, y, z);
+		assert(sums[i] == sum);
+		assert(s.box_sum(b.x1, b.x2, b.y1, b.y2, b.z1, b.z2) == sum);
+	}
+	assert(s.box_mean(1, 1, 2, 2, 3, 3) == m(1, 2, 3));
+}
+
+void test_gather_scatter() {
+	std::cout << "*** TEST gather() e scatter() ***" << std::endl;
+	Matrice3D<float> m(16, 8, 4);
+	for (unsigned int i = 0; i < 16 * 8 * 4; i++)
+		m.data()[i] = float(i);
+
+	std::vector<coord3d> punti;
+	for (unsigned int i = 0; i < 40; i++) {
+		coord3d c = { (i * 5) % 16, (i * 3) % 8, i % 4 };
+		punti.push_back(c);
+	}
+	std::vector<float> valori, ordinati;
+	m.gather(punti, valori);
+	m.gather(punti, ordinati, true);
+	for (std::size_t i = 0; i < punti.size(); i++) {
+		assert(valori[i] == m(punti[i].x, punti[i].y, punti[i].z));
+		assert(ordinati[i] == valori[i]);
+	}
+
+	Matrice3D<float> z(16, 8, 4);
+	z.scatter(punti, valori, true);
+	for (std::size_t i = 0; i < punti.size(); i++)
+		assert(z(punti[i].x, punti[i].y, punti[i].z) == valori[i]);
+
+	// ogni punto ripetuto 3 volte
+	std::vector<unsigned int> indici;
+	std::vector<float> uno;
+	for (int r = 0; r < 3; r++)
+		for (std::size_t i = 0; i < punti.size(); i++) {
+			indici.push_back(m.index_of(punti[i].x, punti[i].y, punti[i].z));
+			uno.push_back(1.0f);
+		}
+	Matrice3D<float> a(16, 8, 4), p(16, 8, 4);
+	a.scatter_add(indici, uno, accumulation::atomic);
+	p.scatter_add(indici, uno, accumulation::privatized, true);
+	assert(a == p);
+	float totale = 0;
+	for (unsigned int i = 0; i < 16 * 8 * 4; i++)
+		totale += a.data()[i];
+	assert(totale == 120.0f);
+
+	bool thrown = false;
+	coord3d fuori = { 16, 0, 0 };
+	try { m.gather(std::vector<coord3d>(1, fuori), valori); }
+	catch (std::out_of_range&) { thrown = true; }
+	assert(thrown);
+}
+
+void test_mask() {
+	std::cout << "*** TEST mask3d ***" << std::endl;
+	Matrice3D<int> m(7, 5, 3); // 105 elementi, due parole
+	for (unsigned int i = 0; i < 105; i++)
+		m.data()[i] = int(i % 10);
+
+	mask3d alti = m > 6;
+	assert(alti.count() == 30);
+	assert((m == 3).count() == 11);
+	assert(in_range(m, 2, 4).count() == 33);
+	assert((~alti).count() == 75);
+	assert(((m >= 7) & (m <= 9)) == alti);
+	assert(alti(0, 1, 0) == true && alti(6, 0, 0) == false); // elementi 7 e 6
+	assert(masked_sum(m, alti) == 30 * 8);
+	assert(masked_reduce(m, m < 5, 0, [](int a, int b) { return a > b ? a : b; }) == 4);
+
+	std::vector<coord3d> c = masked_coords(m == 9);
+	assert(c.size() == 10);
+	for (std::size_t i = 0; i < c.size(); i++)
+		assert(m(c[i].x, c[i].y, c[i].z) == 9);
+
+	Matrice3D<int> copia(7, 5, 3);
+	masked_copy(copia, m, alti);
+	masked_fill(m, alti, -1);
+	assert((m == -1).count() == 30);
+	assert(masked_sum(copia, ~alti) == 0);
+
+	// la coda dell'ultima parola resta a zero
+	mask3d pieno(7, 5, 3);
+	pieno.set_word(0, ~std::uint64_t(0));
+	pieno.set_word(1, ~std::uint64_t(0));
+	assert(pieno.count() == 105 && pieno.words()[1] == (std::uint64_t(1) << 41) - 1);
+}
+
+void test_matrice3d_testo() {
+	std::cout << "*** TEST write_text() e read_text() ***" << std::endl;
+	Matrice3D<double> m(4, 3, 2);
+	for (unsigned int i = 0; i < 24; i++)
+		m.data()[i] = i * 0.1 - 1.0;
+
+	std::stringstream csv;
+	write_text(csv, m, ',');
+	assert(csv.str().substr(0, 6) == "4,3,2\n");
+	Matrice3D<double> letta = read_text<double>(csv);
+	assert(letta == m);
+
+	std::istringstream spazi("2 1 2\n 1   -2\n3\t4\n");
+	Matrice3D<int> k = read_text<int>(spazi);
+	assert(k(0, 0, 0) == 1 && k(1, 0, 0) == -2 && k(0, 0, 1) == 3 && k(1, 0, 1) == 4);
+
+	bool thrown = false;
+	std::istringstream corta("2 2 1\n1 2 3\n");
+	try { read_text<int>(corta); }
+	catch (std::invalid_argument&) { thrown = true; }
+	assert(thrown);
+}
+
+template <accumulation Mode>
+void riempi_istogramma(Matrice3D<long long>& h) {
+	concurrent_accumulator<long long, bounds_throw, Mode> acc(h);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+		threads.emplace_back([&acc, t] {
+			typename concurrent_accumulator<long long, bounds_throw, Mode>::handle local = acc.local();
+			for (unsigned int i = 0; i < 20000; i++)
+				local.add((i + t) % 50, i % 30, (i / 7) % 10, 1);
+		});
+	for (std::size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	acc.merge();
+}
+
+void test_concurrent_accumulator() {
+	std::cout << "*** TEST concurrent_accumulator ***" << std::endl;
+	Matrice3D<long long> a(50, 30, 10), p(50, 30, 10);
+	riempi_istogramma<accumulation::atomic>(a);
+	riempi_istogramma<accumulation::privatized>(p);
+	assert(a == p);
+	long long totale = 0;
+	for (unsigned int i = 0; i < 50 * 30 * 10; i++)
+		totale += p.data()[i];
+	assert(totale == 80000);
+}
+
+struct raddoppia {
+	int operator()(int v) const { return 2 * v; }
+};
+
+void test_matrice3d_transform() {
+	std::cout << "*** TEST Matrice3D copia, spostamento e transform ***" << std::endl;
+	Matrice3D<int> m(4, 3, 2);
+	for (unsigned int i = 0; i < 24; i++)
+		m.data()[i] = int(i);
+
+	Matrice3D<int> copia(m);
+	assert(copia == m && copia.data() != m.data());
+	int* dati = copia.data();
+	Matrice3D<int> spostata(std::move(copia));
+	assert(spostata.data() == dati && copia.data() == nullptr);
+	copia = spostata;
+	assert(copia == m);
+
+	Matrice3D<int> doppia = transform<raddoppia, int>(m);
+	Matrice3D<int> doppia_par = transform<raddoppia, int>(m, parallel::par);
+	assert(doppia == doppia_par && doppia(3, 2, 1) == 46);
+
+	int* riusati = spostata.data();
+	Matrice3D<int> riuso = transform<raddoppia, int>(std::move(spostata));
+	assert(riuso.data() == riusati && riuso == doppia);
+
+	transform_inplace(m, raddoppia(), parallel::par);
+	assert(m == doppia);
+
+	zip_transform(m, doppia, m, [](int a, int b) { return a - b; });
+	assert((m == 0).count() == 24);
+}
+
 struct utente {
 	std::string nome;
 	std::string cognome;
@@ -125,6 +580,485 @@ struct utente {
 		nome(n), cognome(c) {}
 };
 
+void test_stack_crescita() {
+	std::cout << "*** TEST stack con crescita geometrica ***" << std::endl;
+	stack<int> fisso(2);
+	fisso.push(1);
+	fisso.push(2);
+	bool pieno = false;
+	try {
+		fisso.push(3);
+	}
+	catch (std::overflow_error&) {
+		pieno = true;
+	}
+	assert(pieno && fisso.getSize() == 2);
+
+	stack<int, geometric_growth> g;
+	for (int i = 0; i < 1000; i++)
+		g.push(i);
+	assert(g.getActualSize() == 1000 && g.getSize() == 1024);
+	for (int i = 999; i >= 0; i--)
+		assert(g.pop() == i);
+	assert(g.getSize() == 1024);
+	g.shrink_to_fit();
+	assert(g.getSize() == 0 && g.getPointer() == nullptr);
+
+	stack<std::string, hysteresis_growth> h;
+	h.reserve(100);
+	assert(h.getSize() == 100);
+	for (int i = 0; i < 100; i++)
+		h.push(std::string(40, char('a' + i % 26)));
+	h.push("oltre");
+	assert(h.getSize() == 200);
+	while (h.getActualSize() > 10)
+		h.pop();
+	assert(h.getSize() == 25);
+	assert(h.peek() == std::string(40, 'j') && h.getValue(0) == std::string(40, 'a'));
+
+	stack<std::string, hysteresis_growth> copia(h);
+	assert(copia == h);
+	copia.empty();
+	assert(copia.isEmpty() && copia.getSize() <= 16);
+}
+
+void test_stack_spostamento() {
+	std::cout << "*** TEST stack push, emplace e pop con spostamento ***" << std::endl;
+	stack<std::unique_ptr<int>, geometric_growth> p;
+	std::unique_ptr<int> uno(new int(1));
+	p.push(std::move(uno));
+	assert(!uno);
+	for (int i = 2; i <= 20; i++)
+		assert(*p.emplace(new int(i)) == i);
+	std::unique_ptr<int> cima = p.pop();
+	assert(*cima == 20);
+	p.pop_into(cima);
+	assert(*cima == 19 && p.getActualSize() == 18);
+
+	stack<std::string, geometric_growth> s;
+	for (int i = 0; i < 8; i++)
+		s.push(std::string(30, char('a' + i)));
+	assert(s.isFull());
+	s.push(*s.begin()); // l'elemento copiato sta nel buffer che viene riallocato
+	assert(s.getActualSize() == 9 && s.peek() == std::string(30, 'h'));
+	const std::string c(30, 'z');
+	s.push(c);
+	s.emplace(3, 'x');
+	std::string fuori;
+	s.pop_into(fuori);
+	assert(fuori == "xxx" && s.pop() == c);
+}
+
+template <contention M>
+void verifica_concurrent_stack() {
+	const int thread = 8;
+	const int per_thread = 20000;
+	concurrent_stack<int, M> s;
+	std::vector<std::vector<int> > estratti(thread);
+	std::vector<std::thread> t;
+	for (int i = 0; i < thread; i++)
+		t.emplace_back([&s, &estratti, i, per_thread] {
+			for (int k = 0; k < per_thread; k++) {
+				s.push(i * per_thread + k);
+				int v;
+				if (k % 2 == 1 && s.try_pop(v))
+					estratti[i].push_back(v);
+			}
+		});
+	for (std::size_t i = 0; i < t.size(); i++)
+		t[i].join();
+
+	std::vector<int> tutti;
+	for (int i = 0; i < thread; i++)
+		tutti.insert(tutti.end(), estratti[i].begin(), estratti[i].end());
+	assert(s.size_approx() + tutti.size() == std::size_t(thread * per_thread));
+	int v;
+	while (s.try_pop(v))
+		tutti.push_back(v);
+	assert(s.size_approx() == 0 && !s.try_pop(v));
+	std::sort(tutti.begin(), tutti.end());
+	for (int i = 0; i < thread * per_thread; i++)
+		assert(tutti[i] == i);
+}
+
+void test_concurrent_stack() {
+	std::cout << "*** TEST concurrent_stack ***" << std::endl;
+	verifica_concurrent_stack<contention::cas>();
+	verifica_concurrent_stack<contention::elimination>();
+
+	concurrent_stack<std::string, contention::elimination> parole;
+	parole.push(std::string("primo"));
+	parole.push(std::string(50, 'x'));
+	std::string p;
+	assert(parole.try_pop(p) && p == std::string(50, 'x'));
+	assert(parole.size_approx() == 1);
+}
+
+void test_work_stealing_deque() {
+	std::cout << "*** TEST work_stealing_deque ***" << std::endl;
+	const int n = 100000;
+	const int ladri = 3;
+	work_stealing_deque<int> d(4);
+	std::atomic<bool> fine(false);
+	std::vector<std::vector<int> > rubati(ladri);
+	std::vector<std::thread> t;
+	for (int i = 0; i < ladri; i++)
+		t.emplace_back([&d, &fine, &rubati, i] {
+			int v;
+			while (!fine.load() || d.size_approx() > 0)
+				if (d.try_steal(v))
+					rubati[i].push_back(v);
+		});
+
+	std::vector<int> propri;
+	int v;
+	for (int i = 0; i < n; i++) {
+		d.push(i);
+		if (i % 3 == 0 && d.try_pop(v))
+			propri.push_back(v);
+	}
+	while (d.try_pop(v))
+		propri.push_back(v);
+	fine.store(true);
+	for (std::size_t i = 0; i < t.size(); i++)
+		t[i].join();
+	assert(d.capacity() >= 4 && !d.try_pop(v) && !d.try_steal(v));
+
+	for (int i = 0; i < ladri; i++)
+		propri.insert(propri.end(), rubati[i].begin(), rubati[i].end());
+	std::sort(propri.begin(), propri.end());
+	assert(propri.size() == std::size_t(n));
+	for (int i = 0; i < n; i++)
+		assert(propri[i] == i);
+
+	work_stealing_deque<int> solo(2);
+	for (int i = 0; i < 10; i++)
+		solo.push(i);
+	assert(solo.capacity() == 16 && solo.size_approx() == 10);
+	assert(solo.try_steal(v) && v == 0);
+	assert(solo.try_pop(v) && v == 9);
+}
+
+void test_stack_blocchi() {
+	std::cout << "*** TEST stack push_range e pop_n ***" << std::endl;
+	int dati[6] = { 1, 2, 3, 4, 5, 6 };
+	stack<int> s(dati, dati + 6);
+	assert(s.isFull() && s.peek() == 6);
+	int fuori[4];
+	assert(s.pop_n(4, fuori) == fuori + 4);
+	assert(fuori[0] == 3 && fuori[3] == 6 && s.peek() == 2);
+	s.push_range(fuori, fuori + 4);
+	stack<int> uguale(dati, dati + 6);
+	assert(s == uguale);
+
+	bool pieno = false;
+	try {
+		s.pop_n(2, fuori);
+		s.push_range(dati, dati + 3);
+	}
+	catch (std::overflow_error&) {
+		pieno = true;
+	}
+	assert(pieno && s.getActualSize() == 4); // nessun elemento inserito
+
+	stack<std::string, geometric_growth> g;
+	std::vector<std::string> parole(100, std::string(20, 'p'));
+	g.push("base");
+	g.push_range(parole.begin(), parole.end());
+	assert(g.getActualSize() == 101 && g.getSize() == 128);
+	std::vector<std::string> tolte;
+	g.pop_n(100, std::back_inserter(tolte));
+	assert(tolte == parole && g.peek() == "base");
+
+	std::istringstream numeri("7 8 9");
+	g.fillUsingIterator(std::istream_iterator<std::string>(numeri), std::istream_iterator<std::string>());
+	assert(g.getActualSize() == 3 && g.peek() == "9");
+}
+
+// lancia un'eccezione alla copia numero limite
+struct copia_fallita {
+	static int copie;
+	static int limite;
+	int valore;
+
+	copia_fallita(int v) : valore(v) {}
+	copia_fallita(const copia_fallita& other) : valore(other.valore) {
+		if (++copie == limite)
+			throw std::runtime_error("copia fallita");
+	}
+};
+
+int copia_fallita::copie = 0;
+int copia_fallita::limite = 0;
+
+void test_small_stack() {
+	std::cout << "*** TEST small_stack ***" << std::endl;
+#ifdef CONTAINERS_TRACE
+	std::uint64_t allocati = trace::counters_for("small_stack").allocations.load();
+#endif
+	small_stack<int, 4> s;
+	for (int i = 1; i <= 4; i++)
+		s.push(i);
+	assert(s.isInline() && s.getSize() == 4 && s.peek() == 4);
+	const char* oggetto = reinterpret_cast<const char*>(&s);
+	const char* dati = reinterpret_cast<const char*>(s.getPointer());
+	assert(dati >= oggetto && dati < oggetto + sizeof(s));
+#ifdef CONTAINERS_TRACE
+	assert(trace::counters_for("small_stack").allocations.load() == allocati);
+#endif
+
+	s.push(5);
+	assert(!s.isInline() && s.getSize() == 8 && s.getActualSize() == 5);
+	std::vector<int> ordine(s.begin(), s.end());
+	assert(ordine.size() == 5 && ordine[0] == 5 && ordine[4] == 1);
+	int v;
+	s.pop_into(v);
+	assert(v == 5 && s.pop() == 4);
+
+	small_stack<int, 4> copia(s);
+	assert(copia == s && copia.isInline());
+	small_stack<int, 4> spostata(std::move(s));
+	assert(spostata == copia && s.isEmpty());
+
+	small_stack<std::string, 2> parole;
+	parole.push("uno");
+	parole.emplace(30, 'd');
+	parole.push(parole.peek()); // l'elemento copiato sta nella memoria interna che viene lasciata
+	assert(!parole.isInline() && parole.peek() == std::string(30, 'd'));
+	small_stack<std::string, 2> altre;
+	altre = parole;
+	assert(altre == parole);
+	altre = std::move(parole);
+	assert(altre.getActualSize() == 3 && parole.isEmpty() && parole.isInline());
+	altre.empty();
+	assert(altre.isEmpty());
+
+	// una copia che fallisce dopo essere passata allo heap non perde il blocco
+	small_stack<copia_fallita, 2> grande;
+	for (int i = 0; i < 5; i++)
+		grande.emplace(i);
+	copia_fallita::copie = 0;
+	copia_fallita::limite = 3;
+	bool fallita = false;
+	try {
+		small_stack<copia_fallita, 2> copia_grande(grande);
+	}
+	catch (std::runtime_error&) {
+		fallita = true;
+	}
+	assert(fallita && grande.getActualSize() == 5);
+	copia_fallita::limite = 0;
+}
+
+void test_segmented_stack() {
+	std::cout << "*** TEST segmented_stack ***" << std::endl;
+	segmented_stack<int, 64> s;
+	s.push(0);
+	const int* primo = &s.peek();
+	int* medio = nullptr;
+	for (int i = 1; i < 1000; i++) {
+		int& e = s.emplace(i);
+		if (i == 500)
+			medio = &e;
+	}
+	assert(*primo == 0 && *medio == 500 && s.getActualSize() == 1000 && s.chunks() == 16);
+
+	int atteso = 999;
+	for (segmented_stack<int, 64>::const_iterator i = s.begin(); i != s.end(); ++i)
+		assert(*i == atteso--);
+	assert(atteso == -1);
+
+	for (int i = 0; i < 400; i++)
+		s.pop();
+	assert(s.peek() == 599 && *medio == 500 && s.chunks() == 16);
+	for (int i = 0; i < 400; i++)
+		s.push(i); // riusa i blocchi in cache
+	assert(s.chunks() == 16 && s.peek() == 399);
+
+	segmented_stack<int, 64> copia(s);
+	assert(copia.getActualSize() == 1000 && copia.chunks() == 16);
+	s.empty();
+	assert(s.isEmpty() && s.begin() == s.end() && s.chunks() == 16);
+	s.shrink_to_fit();
+	assert(s.chunks() == 0);
+
+	segmented_stack<std::string, 2> parole;
+	for (int i = 0; i < 5; i++)
+		parole.push(std::string(20, char('a' + i)));
+	std::string p;
+	parole.pop_into(p);
+	assert(p == std::string(20, 'e') && parole.pop() == std::string(20, 'd'));
+	segmented_stack<std::string, 2> altre(std::move(parole));
+	assert(parole.isEmpty() && altre.getActualSize() == 3 && altre.peek() == std::string(20, 'c'));
+	altre.shrink_to_fit();
+	assert(altre.chunks() == 2);
+}
+
+void test_scratch_arena() {
+	std::cout << "*** TEST scratch_arena ***" << std::endl;
+	scratch_arena arena(1024);
+	std::pmr::vector<int> fissi(&arena);
+	fissi.reserve(16);
+	scratch_arena::marker inizio = arena.mark();
+
+	void* a = arena.allocate(100, 8);
+	void* b = arena.allocate(10, 64);
+	assert(reinterpret_cast<std::uintptr_t>(b) % 64 == 0 && b > a);
+	arena.deallocate(b, 10, 64); // ultima allocazione: torna libera
+	assert(arena.allocate(10, 64) == b);
+
+	{
+		std::pmr::vector<std::pmr::string> righe(&arena);
+		for (int i = 0; i < 200; i++)
+			righe.emplace_back(std::string(50, char('a' + i % 26)));
+		assert(righe[199].size() == 50 && righe[199][49] == 'r');
+	}
+	std::size_t capacita = arena.capacity();
+	assert(capacita > 1024);
+
+	arena.release_to(inizio);
+	assert(arena.allocate(100, 8) == a); // la memoria dopo il marker viene riusata
+	void* grande = arena.allocate(100000, 16);
+	assert(grande != nullptr && arena.capacity() >= capacita);
+
+	for (int i = 0; i < 16; i++)
+		fissi.push_back(i);
+	assert(fissi[15] == 15);
+
+	arena.reset();
+	std::size_t dopo = arena.capacity();
+	assert(arena.allocate(100, 8) != nullptr && arena.capacity() == dopo);
+	arena.release();
+	assert(arena.capacity() == 0);
+
+	// blocco non multiplo dell'allineamento: l'allineamento supera la fine del blocco
+	scratch_arena piccola(1000);
+	char* primo = static_cast<char*>(piccola.allocate(999, 1));
+	char* allineato = static_cast<char*>(piccola.allocate(8, 64));
+	assert(reinterpret_cast<std::uintptr_t>(allineato) % 64 == 0);
+	assert(allineato < primo || allineato >= primo + 1000);
+	assert(piccola.capacity() > 1000);
+	std::memset(allineato, 0, 8);
+
+	// richieste troppo grandi: std::bad_alloc, senza cicli infiniti ne' overflow
+	std::size_t massimo = std::numeric_limits<std::size_t>::max();
+	std::size_t richieste[] = { massimo - 100, massimo - 3 }; // traboccano il raddoppio del blocco e l'allineamento
+	for (std::size_t i = 0; i < 2; i++) {
+		bool rifiutata = false;
+		try {
+			(void)piccola.allocate(richieste[i], 8);
+		}
+		catch (std::bad_alloc&) {
+			rifiutata = true;
+		}
+		assert(rifiutata);
+	}
+	assert(piccola.allocate(8, 8) != nullptr);
+}
+
+void test_stack_checkpoint() {
+	std::cout << "*** TEST stack checkpoint e rollback ***" << std::endl;
+	stack<int, geometric_growth> decisioni;
+	decisioni.push(1);
+	stack<int, geometric_growth>::checkpoint_token esterno = decisioni.checkpoint();
+	for (int i = 2; i <= 100; i++)
+		decisioni.push(i);
+	stack<int, geometric_growth>::checkpoint_token interno = decisioni.checkpoint();
+	decisioni.push(101);
+	decisioni.rollback(interno);
+	assert(decisioni.getActualSize() == 100 && decisioni.peek() == 100);
+	decisioni.rollback(esterno);
+	assert(decisioni.getActualSize() == 1 && decisioni.peek() == 1);
+
+	bool invalido = false;
+	try {
+		decisioni.rollback(interno);
+	}
+	catch (std::invalid_argument&) {
+		invalido = true;
+	}
+	assert(invalido && decisioni.getActualSize() == 1);
+
+	// un checkpoint annullato resta invalido anche quando lo stack ricresce
+	stack<int, geometric_growth>::checkpoint_token fuori = decisioni.checkpoint();
+	for (int i = 0; i < 10; i++)
+		decisioni.push(i);
+	stack<int, geometric_growth>::checkpoint_token dentro = decisioni.checkpoint();
+	decisioni.rollback(fuori);
+	for (int i = 0; i < 20; i++)
+		decisioni.push(i);
+	invalido = false;
+	try {
+		decisioni.rollback(dentro);
+	}
+	catch (std::invalid_argument&) {
+		invalido = true;
+	}
+	assert(invalido && decisioni.getActualSize() == 21);
+
+	// anche un pop sotto il checkpoint lo invalida
+	stack<int, geometric_growth>::checkpoint_token cima = decisioni.checkpoint();
+	decisioni.pop();
+	decisioni.push(0);
+	invalido = false;
+	try {
+		decisioni.rollback(cima);
+	}
+	catch (std::invalid_argument&) {
+		invalido = true;
+	}
+	assert(invalido);
+	decisioni.rollback(fuori); // il checkpoint esterno resta valido
+	assert(decisioni.getActualSize() == 1);
+	decisioni.rollback(fuori);
+	assert(decisioni.getActualSize() == 1);
+
+	stack<std::string, hysteresis_growth> parole;
+	stack<std::string, hysteresis_growth>::checkpoint_token vuoto = parole.checkpoint();
+	for (int i = 0; i < 64; i++)
+		parole.push(std::string(40, 'w'));
+	std::size_t capacita = parole.getSize();
+	parole.rollback(vuoto);
+	assert(parole.isEmpty() && parole.getSize() == capacita); // rollback non rialloca
+	parole.shrink_to_fit();
+	assert(parole.getSize() == 0);
+	parole.push("dopo");
+	assert(parole.peek() == "dopo");
+}
+
+void test_trace() {
+#ifdef CONTAINERS_TRACE
+	std::cout << "*** TEST tracciamento dei contenitori ***" << std::endl;
+	trace::counters& c = trace::counters_for("stack");
+	std::uint64_t costruiti = c.constructions.load();
+	std::uint64_t allocati = c.bytes.load();
+	std::uint64_t accessi = c.accesses.load();
+	{
+		stack<int> s(4);
+		s.push(1);
+		s.push(2);
+		s.pop();
+		stack<int> copia(s);
+		assert(copia.pop() == 1);
+	}
+	assert(c.constructions.load() == costruiti + 1);
+	assert(c.copies.load() >= 1);
+	assert(c.bytes.load() == allocati + 2 * 4 * sizeof(int));
+	assert(c.accesses.load() == accessi + 4);
+
+	std::thread altro([] { stack<int> s(1); s.push(7); });
+	altro.join();
+
+	std::ostringstream json;
+	trace::dump_chrome_json(json);
+	const std::string out = json.str();
+	assert(out.compare(0, 15, "{\"traceEvents\":") == 0);
+	assert(out.find("\"name\":\"stack::push(T)\"") != std::string::npos);
+	assert(out.find("\"tid\":1") != std::string::npos);
+	assert(out.find("\"ph\":\"C\"") != std::string::npos);
+#endif
+}
+
 int main(int argc, char* argv[]) {
 	// Test con array3d su interi: array3d<int> 
 	array3d<int> b(3, 3, 3, 0);
@@ -146,6 +1080,52 @@ int main(int argc, char* argv[]) {
 
 	//test_iteratori_int();
 
+	test_slab_stream_int();
+
+	test_convert();
+
+	test_confronto_int();
+
+	test_pool_allocator_int();
+
+	test_matrice3d_accesso();
+
+	test_matrice3d_slice();
+
+	test_gemm_batched();
+
+	test_summed_volume();
+
+	test_gather_scatter();
+
+	test_mask();
+
+	test_matrice3d_testo();
+
+	test_concurrent_accumulator();
+
+	test_matrice3d_transform();
+
+	test_stack_crescita();
+
+	test_stack_spostamento();
+
+	test_concurrent_stack();
+
+	test_work_stealing_deque();
+
+	test_stack_blocchi();
+
+	test_small_stack();
+
+	test_segmented_stack();
+
+	test_scratch_arena();
+
+	test_stack_checkpoint();
+
+	test_trace();
+
 	// Test con dbuffer su tipi custom: es. dbuffer<utente>
 
 	// Rifare tutti i test come sopra
@@ -153,4 +1133,4 @@ int main(int argc, char* argv[]) {
 	// test_dbuffer_utente();
 	// ...
 	return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
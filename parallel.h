@@ -0,0 +1,137 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread> // std::thread
+#include <vector>
+#include <exception> // std::exception_ptr
+#include <cstddef> // std::size_t
+#include <algorithm> // std::min
+#include <type_traits>
+
+/**
+  @file parallel.h
+  @brief helpers to split a loop over an index range among threads
+*/
+
+namespace parallel {
+
+	/**
+	@brief Number of threads used by the parallel loops.
+	*/
+	inline unsigned int max_threads() {
+		unsigned int n = std::thread::hardware_concurrency();
+		return n == 0 ? 1 : n;
+	}
+
+	/**
+	@brief Parallel loop over an index range.
+
+	Splits [begin, end) into contiguous sub-ranges of at least `grain`
+	indices and calls f(first, last) on each of them, one per thread. The
+	calling thread runs the first sub-range; small ranges run entirely on
+	the calling thread. The first exception thrown by f is rethrown after
+	all threads have been joined.
+
+	@param begin first index
+	@param end one past the last index
+	@param grain minimum number of indices given to a thread
+	@param f function object called as f(first, last)
+
+	@throw std::system_error a thread could not be started; the threads
+	already started are joined first
+	*/
+	template <typename F>
+	void for_range(std::size_t begin, std::size_t end, std::size_t grain, F f) {
+		if (end <= begin)
+			return;
+		std::size_t count = end - begin;
+		std::size_t chunks = std::min<std::size_t>(max_threads(), count / (grain == 0 ? 1 : grain));
+		if (chunks <= 1) {
+			f(begin, end);
+			return;
+		}
+
+		std::size_t step = count / chunks, extra = count % chunks;
+		std::vector<std::thread> threads;
+		std::vector<std::exception_ptr> errors(chunks);
+		threads.reserve(chunks - 1);
+		std::size_t first = begin + step + (extra > 0 ? 1 : 0);
+		try {
+			for (std::size_t c = 1; c < chunks; c++) {
+				std::size_t last = first + step + (c < extra ? 1 : 0);
+				threads.emplace_back([&f, &errors, c, first, last] {
+					try {
+						f(first, last);
+					}
+					catch (...) {
+						errors[c] = std::current_exception();
+					}
+				});
+				first = last;
+			}
+		}
+		catch (...) { // a thread could not start: the running ones still use f and errors
+			for (std::size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+			throw;
+		}
+		try {
+			f(begin, begin + step + (extra > 0 ? 1 : 0));
+		}
+		catch (...) {
+			errors[0] = std::current_exception();
+		}
+		for (std::size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		for (std::size_t c = 0; c < chunks; c++)
+			if (errors[c])
+				std::rethrow_exception(errors[c]);
+	}
+
+	/**
+	@brief Execution policies of the element-wise algorithms.
+
+	With sequential_policy the work runs on the calling thread, with
+	parallel_policy it is split among threads by for_range.
+	*/
+	struct sequential_policy {};
+	struct parallel_policy {};
+
+	inline constexpr sequential_policy seq{};
+	inline constexpr parallel_policy par{};
+
+	template <typename F>
+	void for_range(sequential_policy, std::size_t begin, std::size_t end, std::size_t, F f) {
+		if (begin < end)
+			f(begin, end);
+	}
+
+	template <typename F>
+	void for_range(parallel_policy, std::size_t begin, std::size_t end, std::size_t grain, F f) {
+		for_range(begin, end, grain, f);
+	}
+
+	/**
+	@brief Atomically adds v to *p (relaxed ordering).
+
+	Integers use a hardware fetch-and-add, floating point values a
+	compare-and-swap loop. p must be suitably aligned for atomic access.
+	*/
+	template <typename T>
+	void atomic_add(T* p, T v) {
+		static_assert(std::is_arithmetic<T>::value, "atomic_add needs an arithmetic T");
+		if constexpr (std::is_integral<T>::value) {
+			__atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+		}
+		else {
+			T expected;
+			__atomic_load(p, &expected, __ATOMIC_RELAXED);
+			T desired = expected + v;
+			while (!__atomic_compare_exchange(p, &expected, &desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				desired = expected + v;
+		}
+	}
+
+} // namespace parallel
+
+#endif // !PARALLEL_H
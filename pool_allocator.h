@@ -0,0 +1,243 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include <cstddef> // std::size_t
+#include <vector>
+#include <new> // ::operator new, std::align_val_t
+#include <stdexcept>
+
+/**
+  @file pool_allocator.h
+  @brief size-class memory pool and the allocator that draws from it
+*/
+
+/**
+  @brief Classe size_class_pool
+
+  Memory pool for many small blocks of similar size, such as the patches made
+  by array3d::slice. Requests are rounded up to a power of two (at least 64
+  bytes) and served from the free list of that size class, or carved from
+  large chunks obtained from the global heap. Freed blocks go back to their
+  free list. Requests larger than a quarter of a chunk go to the global heap.
+
+  All the blocks can be given back at once with reset() (the chunks are kept
+  for reuse) or release() (the chunks are freed). The pool is not thread safe:
+  use one pool per thread.
+
+  Every reset() or release() starts a new generation. The memory of the
+  blocks handed out before it goes back to the pool at once, whoever still
+  holds them: a container that outlives a reset must not be used any more,
+  only destroyed, and only if its elements are trivially destructible.
+  The deallocation of such a block is ignored when the caller passes the
+  generation it allocated in (pool_allocator does), so the block cannot
+  enter a free list and be handed out twice.
+*/
+class size_class_pool {
+public:
+	typedef std::size_t size_type;
+
+	/**
+	@brief Constructor
+
+	@param chunk_size bytes requested from the global heap at a time
+
+	@throw std::invalid_argument chunk_size smaller than 4 blocks of the smallest class
+  */
+	explicit size_class_pool(size_type chunk_size = size_type(4) << 20)
+		: _chunk_size(round_up(chunk_size)), _chunk(0), _cursor(nullptr), _end(nullptr) {
+		if (chunk_size < 4 * min_block)
+			throw std::invalid_argument("chunk size too small!");
+		_free.assign(class_of(_chunk_size / 4) + 1, nullptr);
+		_generation = 0;
+	}
+
+	/**
+	@brief Distructor
+
+	frees all the chunks.
+  */
+	~size_class_pool() {
+		release();
+	}
+
+	size_class_pool(const size_class_pool&) = delete;
+	size_class_pool& operator=(const size_class_pool&) = delete;
+
+	/**
+	@brief Allocates a block of at least bytes bytes, aligned to 64 bytes.
+	*/
+	void* allocate(size_type bytes) {
+		if (bytes > _chunk_size / 4)
+			return ::operator new(bytes, std::align_val_t(min_block));
+		size_type c = class_of(bytes);
+		if (_free[c] != nullptr) {
+			void* p = _free[c];
+			_free[c] = *static_cast<void**>(p);
+			return p;
+		}
+		size_type size = min_block << c;
+		if (size_type(_end - _cursor) < size)
+			next_chunk();
+		void* p = _cursor;
+		_cursor += size;
+		return p;
+	}
+
+	/**
+	@brief Gives back a block obtained by allocate(bytes) in the current generation.
+	*/
+	void deallocate(void* p, size_type bytes) {
+		if (p == nullptr)
+			return;
+		if (bytes > _chunk_size / 4) {
+			::operator delete(p, std::align_val_t(min_block));
+			return;
+		}
+		size_type c = class_of(bytes);
+		*static_cast<void**>(p) = _free[c];
+		_free[c] = p;
+	}
+
+	/**
+	@brief Gives back a block obtained by allocate(bytes) in the given
+	generation. A block of an earlier generation was already reclaimed by
+	reset(): only the blocks that come from the global heap are freed.
+	*/
+	void deallocate(void* p, size_type bytes, size_type generation) {
+		if (generation == _generation || bytes > _chunk_size / 4)
+			deallocate(p, bytes);
+	}
+
+	/**
+	@brief Forgets every block handed out from the chunks, keeping the chunks for
+	the next allocations, and starts a new generation. The blocks must not be
+	used afterwards, see the ownership rule above.
+	*/
+	void reset() {
+		for (size_type c = 0; c < _free.size(); c++)
+			_free[c] = nullptr;
+		_chunk = 0;
+		_cursor = _end = nullptr;
+		_generation++;
+	}
+
+	/**
+	@brief Number of reset() and release() calls so far.
+	*/
+	size_type generation() const {
+		return _generation;
+	}
+
+	/**
+	@brief Like reset(), but also gives the chunks back to the global heap.
+	*/
+	void release() {
+		reset();
+		for (size_type i = 0; i < _chunks.size(); i++)
+			::operator delete(_chunks[i], std::align_val_t(min_block));
+		_chunks.clear();
+	}
+
+	/**
+	@brief Bytes obtained from the global heap for the chunks.
+	*/
+	size_type capacity() const {
+		return _chunks.size() * _chunk_size;
+	}
+
+private:
+	static const size_type min_block = 64;
+
+	size_type _chunk_size;
+	std::vector<char*> _chunks; // chunks obtained from the heap
+	size_type _chunk; // index of the next chunk to carve
+	char* _cursor; // first free byte of the current chunk
+	char* _end; // end of the current chunk
+	std::vector<void*> _free; // free list heads, one per size class
+	size_type _generation; // bumped by reset()
+
+	static size_type round_up(size_type bytes) {
+		size_type size = min_block;
+		while (size < bytes)
+			size <<= 1;
+		return size;
+	}
+
+	static size_type class_of(size_type bytes) {
+		size_type c = 0;
+		while ((min_block << c) < bytes)
+			c++;
+		return c;
+	}
+
+	void next_chunk() {
+		if (_chunk == _chunks.size())
+			_chunks.push_back(static_cast<char*>(::operator new(_chunk_size, std::align_val_t(min_block))));
+		_cursor = _chunks[_chunk++];
+		_end = _cursor + _chunk_size;
+	}
+}; //END CLASS size_class_pool
+
+/**
+  @brief Classe pool_allocator
+
+  Standard allocator that draws memory from a size_class_pool, to be used as the
+  allocator of array3d:
+
+	size_class_pool pool;
+	array3d<float, pool_allocator<float> > patch(32, 32, 32, pool_allocator<float>(pool));
+
+  Copies of the allocator share the same pool, which must outlive them.
+  An allocator remembers the generation of the pool of its last allocate(),
+  or of its construction: after a reset() its deallocations are ignored, so
+  a container that outlives the reset can still be destroyed safely. The
+  first allocate() after the reset moves the allocator to the new generation,
+  so an allocator built before a reset keeps recycling its blocks afterwards;
+  by the ownership rule of size_class_pool, it must then no longer free the
+  blocks of the old generation. Allocators of different generations compare
+  unequal.
+*/
+template <typename T>
+class pool_allocator {
+public:
+	typedef T value_type;
+
+	explicit pool_allocator(size_class_pool& pool) : _pool(&pool), _generation(pool.generation()) {}
+
+	template <typename U>
+	pool_allocator(const pool_allocator<U>& other) : _pool(other.pool()), _generation(other.generation()) {}
+
+	T* allocate(std::size_t n) {
+		static_assert(alignof(T) <= 64, "pool_allocator aligns blocks to 64 bytes");
+		_generation = _pool->generation();
+		return static_cast<T*>(_pool->allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, std::size_t n) {
+		_pool->deallocate(p, n * sizeof(T), _generation);
+	}
+
+	size_class_pool* pool() const {
+		return _pool;
+	}
+
+	std::size_t generation() const {
+		return _generation;
+	}
+
+	template <typename U>
+	bool operator==(const pool_allocator<U>& other) const {
+		return _pool == other.pool() && _generation == other.generation();
+	}
+
+	template <typename U>
+	bool operator!=(const pool_allocator<U>& other) const {
+		return !(*this == other);
+	}
+
+private:
+	size_class_pool* _pool;
+	std::size_t _generation; // generation of the pool at the last allocate()
+}; //END CLASS pool_allocator
+
+#endif // !POOL_ALLOCATOR_H
@@ -8,6 +8,7 @@
 #include <iterator> // std::forward_iterator_tag
 #include <cstddef> // std::ptrdiff_t
 #include <stdexcept>
+#include "../trace.h"
 /**
   @file graph.h
   @brief declaration of the graph class
@@ -27,9 +28,8 @@ public:
 	  rapresents a void graph
 	 */
 	graph() : _idArray(nullptr), _adjMatrix(nullptr), _aSize(0) {
-		#ifndef NDEBUG
-			std::cout << "graph::graph()" << std::endl;
-		#endif
+		TRACE_EVENT("graph", "graph::graph()");
+		TRACE_COUNT("graph", constructions, 1);
 	}
 
 	/**
@@ -66,9 +66,8 @@ public:
 			_aSize = 0;
 			throw; // rilancio dell'eccezione !!
 		}
-		#ifndef NDEBUG
-			std::cout << "graph::graph(const graph &)" << std::endl;
-		#endif
+		TRACE_EVENT("graph", "graph::graph(const graph &)");
+		TRACE_COUNT("graph", copies, 1);
 	}
 
 	/**
@@ -83,9 +82,7 @@ public:
 		_adjMatrix = nullptr;
 		_aSize = 0;
 
-		#ifndef NDEBUG
-			std::cout << "graph::~graph()" << std::endl;
-		#endif
+		TRACE_EVENT("graph", "graph::~graph()");
 	}
 
 	/*
@@ -120,9 +117,7 @@ public:
 			this->swap(tmp);
 		}
 
-		#ifndef NDEBUG
-			std::cout << "graph::operator=(const graph &)" << std::endl;
-		#endif
+		TRACE_EVENT("graph", "graph::operator=(const graph &)");
 
 		return *this;
 	}
@@ -145,9 +140,7 @@ public:
 			for (size_type j = 0; j < other._aSize; j++)
 				if (this->_adjMatrix[i][j] != other._adjMatrix[i][j])
 					return false;
-		#ifndef NDEBUG
-			std::cout << "graph::operator==(const graph &)" << std::endl;
-		#endif
+		TRACE_EVENT("graph", "graph::operator==(const graph &)");
 		return true;
 	}
 
@@ -258,9 +251,7 @@ public:
 			delete[] tmpArray;
 			delete[] tmpMatrix;
 			
-			#ifndef NDEBUG
-				std::cout << "ADDING NEW NODE : " << node << std::endl;
-			#endif	
+			TRACE_EVENT("graph", "graph::add_node(const T &)");
 		}
 	}
 	/**
@@ -315,9 +306,7 @@ public:
 			delete[] tmpArray;
 			delete[] tmpMatrix;
 
-			#ifndef NDEBUG
-				std::cout << "REMOVING THE NODE : " << node << std::endl;
-			#endif		
+			TRACE_EVENT("graph", "graph::remove_node(const T &)");
 					
 		}
 	}
@@ -430,9 +419,7 @@ public:
 			}
 			
 		}
-		#ifndef NDEBUG
-			std::cout << "graph::add_nodes(const_interator, const_interator)" << std::endl;
-		#endif		
+		TRACE_EVENT("graph", "graph::add_nodes(const_interator, const_interator)");
 	}
 
 private:
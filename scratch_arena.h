@@ -0,0 +1,190 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uintptr_t
+#include <limits> // std::numeric_limits
+#include <memory_resource> // std::pmr::memory_resource
+#include <new> // std::bad_alloc
+#include <stdexcept>
+#include <vector>
+
+/**
+  @file scratch_arena.h
+  @brief LIFO scratch memory, usable as a std::pmr::memory_resource
+*/
+
+/**
+  @brief Classe scratch_arena
+
+  Bump allocator with the semantics of a stack of bytes: every allocation
+  advances a top pointer inside the current block, and mark() /
+  release_to() save and restore that pointer, freeing everything
+  allocated after the mark in O(1) whatever the number of allocations.
+  When a block is full the next one is taken from the blocks already
+  obtained or, twice as large as the last, from the upstream resource;
+  the blocks are kept until release() or the destruction of the arena.
+
+  Deallocating the most recent allocation gives its bytes back, like a pop;
+  any other deallocation does nothing and the memory comes back with
+  release_to(). The objects living in the released memory are not
+  destroyed: release only memory whose objects are already gone or
+  trivially destructible. The arena is not thread safe: use one per thread
+  or per request.
+*/
+class scratch_arena : public std::pmr::memory_resource {
+public:
+	typedef std::size_t size_type;
+
+	/**
+	@brief A saved top of the arena, see mark() and release_to().
+	*/
+	struct marker {
+		size_type blocks; // blocks in use
+		char* cursor;  // top inside the last of them
+	};
+
+	static constexpr size_type block_alignment = 64;
+
+	/**
+	@brief Constructor
+
+	@param block_size bytes of the first block, the next ones double
+	@param upstream resource that provides the blocks
+
+	@throw std::invalid_argument block_size is zero
+  */
+	explicit scratch_arena(size_type block_size = size_type(64) << 10,
+		std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+		: _upstream(upstream), _next_size(block_size), _used(0), _cursor(nullptr), _end(nullptr) {
+		if (block_size == 0)
+			throw std::invalid_argument("block size cannot be zero!");
+	}
+
+	/**
+	@brief Distructor
+
+	gives all the blocks back to the upstream resource.
+  */
+	~scratch_arena() {
+		release();
+	}
+
+	scratch_arena(const scratch_arena&) = delete;
+	scratch_arena& operator=(const scratch_arena&) = delete;
+
+	/**
+	@brief Current top of the arena.
+	*/
+	marker mark() const {
+		return marker{ _used, _cursor };
+	}
+
+	/**
+	@brief Frees everything allocated after m was taken. The blocks stay
+	with the arena for the next allocations.
+
+	@param m marker returned by mark(), not older than a release_to() to an earlier marker
+	*/
+	void release_to(const marker& m) {
+		_used = m.blocks;
+		_cursor = m.cursor;
+		_end = _used > 0 ? _blocks[_used - 1].data + _blocks[_used - 1].size : nullptr;
+	}
+
+	/**
+	@brief Frees every allocation, keeping the blocks.
+	*/
+	void reset() {
+		release_to(marker{ 0, nullptr });
+	}
+
+	/**
+	@brief Frees every allocation and gives the blocks back to the upstream resource.
+	*/
+	void release() {
+		reset();
+		for (size_type i = 0; i < _blocks.size(); i++)
+			_upstream->deallocate(_blocks[i].data, _blocks[i].size, block_alignment);
+		_blocks.clear();
+	}
+
+	/**
+	@brief Bytes obtained from the upstream resource.
+	*/
+	size_type capacity() const {
+		size_type c = 0;
+		for (size_type i = 0; i < _blocks.size(); i++)
+			c += _blocks[i].size;
+		return c;
+	}
+
+protected:
+	void* do_allocate(size_type bytes, size_type alignment) override {
+		char* p = align_up(_cursor, alignment);
+		if (_cursor == nullptr || p > _end || bytes > size_type(_end - p)) { // aligning can pass the end of the block
+			if (bytes > std::numeric_limits<size_type>::max() - alignment)
+				throw std::bad_alloc();
+			next_block(bytes + alignment - 1);
+			p = align_up(_cursor, alignment);
+		}
+		_cursor = p + bytes;
+		return p;
+	}
+
+	void do_deallocate(void* p, size_type bytes, size_type) override {
+		if (static_cast<char*>(p) + bytes == _cursor) // the last allocation: pop it
+			_cursor = static_cast<char*>(p);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+
+private:
+	struct block {
+		char* data;
+		size_type size;
+	};
+
+	std::pmr::memory_resource* _upstream;
+	std::vector<block> _blocks;  // obtained from _upstream, the first _used are in use
+	size_type _next_size;  // size of the next new block
+	size_type _used;
+	char* _cursor;  // top of the arena
+	char* _end;  // end of the current block
+
+	static char* align_up(char* p, size_type alignment) {
+		std::uintptr_t a = (reinterpret_cast<std::uintptr_t>(p) + alignment - 1) & ~std::uintptr_t(alignment - 1);
+		return reinterpret_cast<char*>(a);
+	}
+
+	/**
+	@brief Moves the top to the start of the next block, which must hold at
+	least bytes bytes. A cached block that is too small is replaced.
+
+	@throw std::bad_alloc no block size can hold bytes bytes
+	*/
+	void next_block(size_type bytes) {
+		if (_used == _blocks.size() || _blocks[_used].size < bytes) {
+			if (_used < _blocks.size()) {
+				_upstream->deallocate(_blocks[_used].data, _blocks[_used].size, block_alignment);
+				_blocks.erase(_blocks.begin() + _used);
+			}
+			size_type size = _next_size;
+			while (size < bytes) {
+				if (size > std::numeric_limits<size_type>::max() / 2)
+					throw std::bad_alloc();
+				size *= 2;
+			}
+			block b = { static_cast<char*>(_upstream->allocate(size, block_alignment)), size };
+			_blocks.insert(_blocks.begin() + _used, b);
+			_next_size = size > std::numeric_limits<size_type>::max() / 2 ? size : size * 2;
+		}
+		_cursor = _blocks[_used].data;
+		_end = _cursor + _blocks[_used].size;
+		_used++;
+	}
+}; //END CLASS scratch_arena
+
+#endif // !SCRATCH_ARENA_H
@@ -0,0 +1,370 @@
+#ifndef SEGMENTED_STACK_H
+#define SEGMENTED_STACK_H
+
+#include <cassert>
+#include <cstddef> // std::ptrdiff_t
+#include <iterator> // std::forward_iterator_tag
+#include <new> // placement new
+#include <stdexcept>
+#include <type_traits>
+#include <utility> // std::forward
+#include "trace.h"
+
+/**
+  @file segmented_stack.h
+  @brief stack made of linked fixed-size chunks
+*/
+
+/**
+  @brief Classe segmented_stack
+
+  Stack of T kept in a linked list of chunks, each holding ChunkSize
+  elements. A full chunk is followed by a new one, so a push never moves
+  the existing elements: pointers and references to them stay valid until
+  they are popped, and no push costs more than the allocation of one chunk.
+
+  The chunks emptied by pop are kept after the current one and reused by
+  the next pushes, so a stack that oscillates around a chunk boundary does
+  not allocate; shrink_to_fit gives them back.
+*/
+template <typename T, unsigned int ChunkSize = 256>
+class segmented_stack {
+	struct chunk;
+
+public:
+	static_assert(ChunkSize > 0, "segmented_stack needs chunks of at least one element");
+
+	typedef std::size_t size_type;
+
+	segmented_stack() : _first(nullptr), _current(nullptr), _used(0), _count(0) {}
+
+	/**
+	@brief Copy Constructor
+
+	@param other stack to copy
+	*/
+	segmented_stack(const segmented_stack& other) : _first(nullptr), _current(nullptr), _used(0), _count(0) {
+		try {
+			for (const chunk* c = other._first; c != nullptr; c = c->next) {
+				size_type n = c == other._current ? other._used : ChunkSize;
+				for (size_type i = 0; i < n; i++)
+					push(c->data()[i]);
+				if (c == other._current)
+					break;
+			}
+		}
+		catch (...) {
+			release();
+			throw;
+		}
+	}
+
+	/**
+	@brief Move Constructor, takes the chunks of other and leaves it empty.
+
+	@param other stack to move
+	*/
+	segmented_stack(segmented_stack&& other) noexcept
+		: _first(other._first), _current(other._current), _used(other._used), _count(other._count) {
+		other._first = nullptr;
+		other._current = nullptr;
+		other._used = 0;
+		other._count = 0;
+	}
+
+	~segmented_stack() {
+		release();
+	}
+
+	segmented_stack& operator=(const segmented_stack& other) {
+		if (this != &other) {
+			segmented_stack tmp(other);
+			this->swap(tmp);
+		}
+		return *this;
+	}
+
+	segmented_stack& operator=(segmented_stack&& other) noexcept {
+		if (this != &other) {
+			release();
+			_first = other._first;
+			_current = other._current;
+			_used = other._used;
+			_count = other._count;
+			other._first = nullptr;
+			other._current = nullptr;
+			other._used = 0;
+			other._count = 0;
+		}
+		return *this;
+	}
+
+	void swap(segmented_stack& other) {
+		std::swap(_first, other._first);
+		std::swap(_current, other._current);
+		std::swap(_used, other._used);
+		std::swap(_count, other._count);
+	}
+
+	size_type getActualSize() const {
+		return _count;
+	}
+
+	bool isEmpty() const {
+		return _count == 0;
+	}
+
+	/**
+	@brief Pushes a copy of value.
+
+	@param value the item to push
+	*/
+	void push(const T& value) {
+		emplace(value);
+	}
+
+	/**
+	@brief Pushes value, moving it.
+
+	@param value the item to push
+	*/
+	void push(T&& value) {
+		emplace(std::move(value));
+	}
+
+	/**
+	@brief Constructs an element in place on the top of the stack.
+
+	@param args arguments of the constructor of T
+
+	@return reference to the new top element, valid until it is popped
+	*/
+	template <typename... Args>
+	T& emplace(Args&&... args) {
+		if (_current == nullptr || _used == ChunkSize)
+			next_chunk();
+		T* p = new (_current->data() + _used) T(std::forward<Args>(args)...);
+		++_used;
+		++_count;
+		return *p;
+	}
+
+	/**
+	@brief Removes the top element and returns it, moved out of the stack.
+
+	@throw std::underflow_error the stack is empty
+	*/
+	T pop() {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		T value(std::move(_current->data()[_used - 1]));
+		remove_top();
+		return value;
+	}
+
+	/**
+	@brief Moves the top element into out and removes it from the stack.
+
+	@param out destination of the top element
+
+	@throw std::underflow_error the stack is empty
+	*/
+	void pop_into(T& out) {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		out = std::move(_current->data()[_used - 1]);
+		remove_top();
+	}
+
+	/**
+	@brief Returns the top element without removing it.
+
+	@throw std::underflow_error the stack is empty
+	*/
+	T& peek() {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		return _current->data()[_used - 1];
+	}
+
+	const T& peek() const {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		return _current->data()[_used - 1];
+	}
+
+	/**
+	@brief Removes all the elements. The chunks are kept for reuse.
+	*/
+	void empty() {
+		if (std::is_trivially_destructible<T>::value && _current != nullptr) {
+			_current = _first;
+			_used = 0;
+			_count = 0;
+		}
+		while (!isEmpty())
+			remove_top();
+	}
+
+	/**
+	@brief Frees the cached chunks that follow the current one.
+	*/
+	void shrink_to_fit() {
+		if (_current == nullptr)
+			return;
+		free_chunks(_current->next);
+		_current->next = nullptr;
+		if (_count == 0) {
+			delete _current;
+			_first = _current = nullptr;
+			_used = 0;
+		}
+	}
+
+	/**
+	@brief Number of chunks allocated, cached ones included.
+	*/
+	size_type chunks() const {
+		size_type n = 0;
+		for (chunk* c = _first; c != nullptr; c = c->next)
+			n++;
+		return n;
+	}
+
+	/**
+	@brief Iteratore costante, from the top to the bottom of the stack.
+	*/
+	class const_iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef T                         value_type;
+		typedef std::ptrdiff_t            difference_type;
+		typedef const T* pointer;
+		typedef const T& reference;
+
+		const_iterator() : _chunk(nullptr), _index(0) {}
+
+		reference operator*() const {
+			return _chunk->data()[_index];
+		}
+
+		pointer operator->() const {
+			return _chunk->data() + _index;
+		}
+
+		const_iterator& operator++() {
+			if (_index > 0)
+				--_index;
+			else {
+				_chunk = _chunk->prev;
+				_index = ChunkSize - 1;
+				if (_chunk == nullptr)
+					_index = 0;
+			}
+			return *this;
+		}
+
+		const_iterator operator++(int) {
+			const_iterator old(*this);
+			++(*this);
+			return old;
+		}
+
+		bool operator==(const const_iterator& other) const {
+			return _chunk == other._chunk && _index == other._index;
+		}
+
+		bool operator!=(const const_iterator& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		const chunk* _chunk;
+		size_type _index;
+
+		friend class segmented_stack;
+
+		const_iterator(const chunk* c, size_type i) : _chunk(c), _index(i) {}
+	}; // classe const_iterator
+
+	// Ritorna l'iteratore all'elemento in cima
+	const_iterator begin() const {
+		return isEmpty() ? end() : const_iterator(_current, _used - 1);
+	}
+
+	// Ritorna l'iteratore dopo l'elemento in fondo
+	const_iterator end() const {
+		return const_iterator();
+	}
+
+private:
+	struct chunk {
+		alignas(T) unsigned char storage[ChunkSize * sizeof(T)];
+		chunk* prev;
+		chunk* next;
+
+		chunk(chunk* p) : prev(p), next(nullptr) {}
+
+		T* data() {
+			return reinterpret_cast<T*>(storage);
+		}
+
+		const T* data() const {
+			return reinterpret_cast<const T*>(storage);
+		}
+	};
+
+	chunk* _first;  // bottom chunk
+	chunk* _current;  // chunk holding the top element
+	size_type _used;  // elements in _current
+	size_type _count;  // elements in the stack
+
+	/**
+	@brief Moves the top to the next chunk, cached or new.
+	*/
+	void next_chunk() {
+		if (_current != nullptr && _current->next != nullptr)
+			_current = _current->next;
+		else {
+			TRACE_COUNT("segmented_stack", allocations, 1);
+			TRACE_COUNT("segmented_stack", bytes, sizeof(chunk));
+			chunk* c = new chunk(_current);
+			if (_current != nullptr)
+				_current->next = c;
+			else
+				_first = c;
+			_current = c;
+		}
+		_used = 0;
+	}
+
+	void remove_top() {
+		_current->data()[--_used].~T();
+		--_count;
+		if (_used == 0 && _current->prev != nullptr) { // the chunk stays cached after the new current
+			_current = _current->prev;
+			_used = ChunkSize;
+		}
+	}
+
+	static void free_chunks(chunk* c) {
+		while (c != nullptr) {
+			chunk* next = c->next;
+			delete c;
+			c = next;
+		}
+	}
+
+	void release() {
+		empty();
+		free_chunks(_first);
+		_first = _current = nullptr;
+		_used = 0;
+	}
+}; //END CLASS segmented_stack
+
+#endif // !SEGMENTED_STACK_H
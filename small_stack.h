@@ -0,0 +1,386 @@
+#ifndef SMALL_STACK_H
+#define SMALL_STACK_H
+
+#include <cassert>
+#include <cstring> // std::memcpy
+#include <iterator> // std::reverse_iterator
+#include <memory> // std::uninitialized_copy
+#include <new> // placement new, std::align_val_t
+#include <ostream> // std::ostream
+#include <stdexcept>
+#include <type_traits>
+#include <utility> // std::move_if_noexcept
+#include "trace.h"
+
+/**
+  @file small_stack.h
+  @brief stack with the first N elements stored inside the object
+*/
+
+/**
+  @brief Classe small_stack
+
+  Stack of T whose first N elements are stored inside the object itself.
+  Only when an (N + 1)-th element is pushed the elements move to the heap,
+  where the capacity then doubles as needed; a stack that never holds more
+  than N elements does not allocate at all. The interface is the one of
+  stack: push, emplace, pop, pop_into, peek and a const_iterator that walks
+  from the top to the bottom.
+*/
+template <typename T, unsigned int N = 32>
+class small_stack {
+public:
+	static_assert(N > 0, "small_stack needs an inline capacity of at least one element");
+
+	typedef unsigned int size_type;
+	typedef std::reverse_iterator<const T*> const_iterator; // from the top to the bottom
+
+	/**
+	@brief Default constructor, an empty stack using the inline storage.
+	*/
+	small_stack() : _data(inline_data()), _size(N), _count(0) {}
+
+	/**
+	@brief Copy Constructor
+
+	@param other stack to copy
+	*/
+	small_stack(const small_stack& other) : _data(inline_data()), _size(N), _count(0) {
+		reserve(other._count);
+		try {
+			std::uninitialized_copy(other._data, other._data + other._count, _data);
+		}
+		catch (...) { // the destructor does not run: free the block reserve() took
+			if (!is_inline())
+				deallocate(_data);
+			throw;
+		}
+		_count = other._count;
+	}
+
+	/**
+	@brief Move Constructor
+
+	Takes the heap buffer of other, or moves its elements one by one if
+	other still uses its inline storage. other is left empty.
+
+	@param other stack to move
+	*/
+	small_stack(small_stack&& other) noexcept(std::is_nothrow_move_constructible<T>::value)
+		: _data(inline_data()), _size(N), _count(0) {
+		take(other);
+	}
+
+	~small_stack() {
+		clear();
+		if (!is_inline())
+			deallocate(_data);
+	}
+
+	small_stack& operator=(const small_stack& other) {
+		if (this != &other) {
+			small_stack tmp(other);
+			*this = std::move(tmp);
+		}
+		return *this;
+	}
+
+	small_stack& operator=(small_stack&& other) noexcept(std::is_nothrow_move_constructible<T>::value) {
+		if (this != &other) {
+			clear();
+			if (!is_inline()) {
+				deallocate(_data);
+				_data = inline_data();
+				_size = N;
+			}
+			take(other);
+		}
+		return *this;
+	}
+
+	/**
+	@brief getters and utility functions
+	*/
+
+	size_type getSize() const { // capacity
+		return _size;
+	}
+
+	size_type getActualSize() const {
+		return _count;
+	}
+
+	const T* getPointer() const { // the bottom element
+		return _data;
+	}
+
+	bool isEmpty() const {
+		return _count == 0;
+	}
+
+	/**
+	@brief true while the elements are stored inside the object.
+	*/
+	bool isInline() const {
+		return is_inline();
+	}
+
+	/**
+	@brief Reserves storage for at least n elements.
+
+	@param n capacity requested
+	*/
+	void reserve(size_type n) {
+		if (n > _size)
+			reallocate(n);
+	}
+
+	/**
+	@brief Pushes a copy of value. value can be an element of the stack itself.
+
+	@param value the item to push
+	*/
+	void push(const T& value) {
+		if (_count == _size) {
+			T copy(value); // value may live in the storage that grow() leaves
+			grow();
+			construct_top(std::move(copy));
+		}
+		else
+			construct_top(value);
+	}
+
+	/**
+	@brief Pushes value, moving it.
+
+	@param value the item to push
+	*/
+	void push(T&& value) {
+		if (_count == _size) {
+			T moved(std::move(value));
+			grow();
+			construct_top(std::move(moved));
+		}
+		else
+			construct_top(std::move(value));
+	}
+
+	/**
+	@brief Constructs an element in place on the top of the stack.
+
+	@param args arguments of the constructor of T
+
+	@return reference to the new top element
+	*/
+	template <typename... Args>
+	T& emplace(Args&&... args) {
+		if (_count == _size) {
+			T value(std::forward<Args>(args)...);
+			grow();
+			return construct_top(std::move(value));
+		}
+		return construct_top(std::forward<Args>(args)...);
+	}
+
+	/**
+	@brief Removes the top element and returns it, moved out of the stack.
+
+	@throw std::underflow_error the stack is empty
+	*/
+	T pop() {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		T value(std::move(_data[_count - 1]));
+		_data[--_count].~T();
+		return value;
+	}
+
+	/**
+	@brief Moves the top element into out and removes it from the stack.
+
+	@param out destination of the top element
+
+	@throw std::underflow_error the stack is empty
+	*/
+	void pop_into(T& out) {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		out = std::move(_data[_count - 1]);
+		_data[--_count].~T();
+	}
+
+	/**
+	@brief Returns the top element without removing it.
+
+	@throw std::underflow_error the stack is empty
+	*/
+	const T& peek() const {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		return _data[_count - 1];
+	}
+
+	/**
+	@brief Removes all the elements. The storage is kept.
+	*/
+	void empty() {
+		clear();
+	}
+
+	/**
+	@brief operator ==
+
+	@param other stack to compare
+	@return true if the two stacks hold the same elements
+	*/
+	bool operator==(const small_stack& other) const {
+		if (_count != other._count)
+			return false;
+		for (size_type i = 0; i < _count; i++)
+			if (!(_data[i] == other._data[i]))
+				return false;
+		return true;
+	}
+
+	// Ritorna l'iteratore all'elemento in cima
+	const_iterator begin() const {
+		return const_iterator(_data + _count);
+	}
+
+	// Ritorna l'iteratore dopo l'elemento in fondo
+	const_iterator end() const {
+		return const_iterator(_data);
+	}
+
+	/**
+	@brief stream operator overload
+
+	@param os output stream
+	@param m stack to print
+
+	@return reference to output stream
+	*/
+	friend std::ostream& operator<<(std::ostream& os, const small_stack& m) {
+		os << "size: " << m.getSize() << std::endl;
+		for (size_type i = 0; i < m._count; i++)
+			os << m._data[i] << " ";
+		os << std::endl;
+		return os;
+	}
+
+private:
+	alignas(T) unsigned char _buffer[N * sizeof(T)]; // inline storage
+	T* _data;  // _buffer or a heap block
+	size_type _size;  // capacity
+	size_type _count;  // elements
+
+	T* inline_data() {
+		return reinterpret_cast<T*>(_buffer);
+	}
+
+	bool is_inline() const {
+		return _data == reinterpret_cast<const T*>(_buffer);
+	}
+
+	template <typename... Args>
+	T& construct_top(Args&&... args) {
+		T* p = new (_data + _count) T(std::forward<Args>(args)...);
+		++_count;
+		return *p;
+	}
+
+	void clear() {
+		if (!std::is_trivially_destructible<T>::value)
+			for (size_type i = 0; i < _count; i++)
+				_data[i].~T();
+		_count = 0;
+	}
+
+	static T* allocate(size_type n) {
+		TRACE_COUNT("small_stack", allocations, 1);
+		TRACE_COUNT("small_stack", bytes, n * sizeof(T));
+		if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			return static_cast<T*>(::operator new(std::size_t(n) * sizeof(T), std::align_val_t(alignof(T))));
+		else
+			return static_cast<T*>(::operator new(std::size_t(n) * sizeof(T)));
+	}
+
+	static void deallocate(T* p) {
+		if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			::operator delete(p, std::align_val_t(alignof(T)));
+		else
+			::operator delete(p);
+	}
+
+	/**
+	@brief Moves the elements of p, n of them, to dst and destroys them in p.
+	*/
+	static void relocate(T* p, size_type n, T* dst) {
+		if (std::is_trivially_copyable<T>::value) {
+			if (n > 0)
+				std::memcpy(static_cast<void*>(dst), p, n * sizeof(T));
+			return;
+		}
+		size_type i = 0;
+		try {
+			for (; i < n; i++)
+				new (dst + i) T(std::move_if_noexcept(p[i]));
+		}
+		catch (...) {
+			for (size_type k = 0; k < i; k++)
+				dst[k].~T();
+			throw;
+		}
+		for (i = 0; i < n; i++)
+			p[i].~T();
+	}
+
+	/**
+	@brief Moves the elements to a heap block of the given capacity.
+	If an exception is thrown the stack is left unchanged.
+	*/
+	void reallocate(size_type capacity) {
+		T* p = allocate(capacity);
+		try {
+			relocate(_data, _count, p);
+		}
+		catch (...) {
+			deallocate(p);
+			throw;
+		}
+		if (!is_inline())
+			deallocate(_data);
+		_data = p;
+		_size = capacity;
+	}
+
+	void grow() {
+		if (_size > ~size_type(0) / 2)
+			throw std::length_error("stack capacity overflow!");
+		reallocate(_size * 2);
+	}
+
+	/**
+	@brief Moves the content of other, whose storage is known to be empty in *this.
+	*/
+	void take(small_stack& other) {
+		if (other.is_inline()) {
+			relocate(other._data, other._count, _data);
+			_count = other._count;
+			other._count = 0;
+		}
+		else {
+			_data = other._data;
+			_size = other._size;
+			_count = other._count;
+			other._data = other.inline_data();
+			other._size = N;
+			other._count = 0;
+		}
+	}
+}; //END CLASS small_stack
+
+#endif // !SMALL_STACK_H
@@ -8,39 +8,94 @@
 #include <cstddef>  // std::ptrdiff_t
 #include <algorithm> //swap
 #include <stdexcept>
+#include <cstring> // std::memcpy
+#include <memory> // std::uninitialized_copy
+#include <new> // placement new, std::align_val_t
+#include <type_traits>
+#include <utility> // std::move_if_noexcept
+#include <vector>
+#include "trace.h"
 
 /**
   @file stack.h
   @brief dichiarazione della classe stack
 */
 
+/**
+  @brief Growth policies of stack
+
+  grow(capacity) returns the capacity to use when a push finds the stack
+  full, 0 to refuse the push. shrink(capacity, count) returns the capacity
+  to keep after elements are removed.
+*/
+
+/**
+  @brief Fixed capacity: push on a full stack throws std::overflow_error.
+*/
+struct fixed_capacity {
+	static unsigned int grow(unsigned int) { return 0; }
+	static unsigned int shrink(unsigned int capacity, unsigned int) { return capacity; }
+};
+
+/**
+  @brief Doubles the capacity of a full stack, never shrinks.
+  Every element is relocated O(1) times on average, so push is amortized O(1).
+*/
+struct geometric_growth {
+	static unsigned int grow(unsigned int capacity) { return capacity < 8 ? 8 : capacity * 2; }
+	static unsigned int shrink(unsigned int capacity, unsigned int) { return capacity; }
+};
+
+/**
+  @brief Doubles the capacity of a full stack and halves it when the stack
+  drops to a quarter of its capacity. After a resize at least capacity/4
+  operations are needed before the next one, so push/pop around a
+  threshold cannot reallocate on every call.
+*/
+struct hysteresis_growth {
+	static unsigned int grow(unsigned int capacity) { return geometric_growth::grow(capacity); }
+	static unsigned int shrink(unsigned int capacity, unsigned int count) {
+		return capacity > 8 && count <= capacity / 4 ? capacity / 2 : capacity;
+	}
+};
+
 /**
   @brief Classe stack
 
   Classe che vuole rappresentare uno stack di oggetti di tipo T.
+  Lo storage non  inizializzato: esistono solo gli elementi tra 0 e _top.
+  The growth policy G decides what happens when the stack is full
+  (fixed_capacity, the default, throws).
 */
 
-template <typename T>
+template <typename T, typename G = fixed_capacity>
 class stack { 
 public:
 
 	typedef unsigned int size_type;
 
+	/**
+	@brief Point of the stack saved by checkpoint(), see rollback().
+	*/
+	struct checkpoint_token {
+		size_type depth;  // elements in the stack when the checkpoint was taken
+		unsigned long long serial;  // tells apart checkpoints taken at the same depth
+	};
+
 	/**
 	 @brief Default constructor
 	  rapresents a void stack
 	 */
 	stack() :_DataPointer(nullptr), _size(0), _top(-1) {
-	#ifndef NDEBUG
-		std::cout << "stack::stack()" << std::endl;
-	#endif
+		TRACE_EVENT("stack", "stack::stack()");
+		TRACE_COUNT("stack", constructions, 1);
 	}
 
 	/**
 	@brief secondary constructor
 
 	Secondary constructor that creates a stack by the given dimension.
-	Stack's data is not initialized.
+	Stack's data is not initialized: the storage is reserved, no T is constructed.
 
 	@param size _size of the stack
 
@@ -52,7 +107,7 @@ public:
 		assert(size >= 0);
 		if (size >= 0) {
 			try {
-				_DataPointer = new T[size];
+				_DataPointer = allocate(size);
 				_size = size;
 				_top = -1;
 			}
@@ -62,31 +117,29 @@ public:
 				_top = -1;
 				throw;
 			}
-		#ifndef NDEBUG
-			std::cout << "stack::stack(size_type)" << std::endl;
-		#endif
+			TRACE_EVENT("stack", "stack::stack(size_type)");
+			TRACE_COUNT("stack", constructions, 1);
 		}
 		else throw std::invalid_argument("negative dimensions are not valid!");
 	}
 	template<class I>
 	stack(I start, I end) : _DataPointer(nullptr), _size(0), _top(-1) {
-		_DataPointer = new T[end - start]; //distanza tra i due iteratori, operatore difference_type degli iteratori
+		_DataPointer = allocate(end - start); //distanza tra i due iteratori, operatore difference_type degli iteratori
 		_size = end - start;
 		_top = -1;
 		try {
-			for (; start != end; start++)
-						push(*start);
+			push_range(start, end);
 		}
 		catch (...) {
+			deallocate(_DataPointer);
 			_DataPointer = nullptr;
 			_size = 0;
 			_top = -1;
 			throw;
 		}
 		
-	#ifndef NDEBUG
-		std::cout << "stack::stack(I, I)" << std::endl;
-	#endif
+		TRACE_EVENT("stack", "stack::stack(I, I)");
+		TRACE_COUNT("stack", constructions, 1);
 	}
 
 	/**
@@ -95,14 +148,13 @@ public:
 	the distructor deallocates the memory allocated on the heap by the stack.
   */
 	~stack() {
-		delete[] _DataPointer;
+		destroy(_DataPointer, getActualSize());
+		deallocate(_DataPointer);
 		_DataPointer = nullptr;
 		_size = 0;
 		_top = -1;
 
-	#ifndef NDEBUG
-		std::cout << "stack::~stack()" << std::endl;
-	#endif
+		TRACE_EVENT("stack", "stack::~stack()");
 	}
 
 	/*
@@ -115,8 +167,7 @@ public:
 	void fillUsingIterator(I start, I end) {
 		if (!isEmpty())  //se stack contiene gi dati, questi vengono rimossi.
 			empty();
-		for (; start != end; start++)
-			push(*start);
+		push_range(start, end);
 	}
 
 
@@ -124,7 +175,7 @@ public:
 	@brief getters and utility functions for the stack class
 	*/
 
-	size_type getSize() const { //max size defined
+	size_type getSize() const { //capacity
 		return this->_size;
 	}
 
@@ -158,27 +209,134 @@ public:
 	/**
 	@brief Stack push function
 
-	Insert an element of type T to the stack, if it isn't full.
-	Throws overflow error if stack is full.
+	Insert a copy of value to the stack. A full stack grows as the
+	policy G says. value can be an element of the stack itself.
 
 	@param value the item to push
 
+	@throw std::overflow_error the stack is full and G does not grow it
+
 	@post _top = top + 1 */
-	void push(T value) {
+	void push(const T& value) {
 		if (isFull()) {
-			throw std::overflow_error("stack is full!");
-			exit(EXIT_FAILURE);
+			T copy(value); // value may live in the buffer that grow() frees
+			grow(_size + 1);
+			construct_top(std::move(copy));
 		}
-		else{
-			std::cout << "INSERTING TO STACK: " << value << std::endl;
-			_DataPointer[++_top] = value;
+		else
+			construct_top(value);
+	}
+
+	/**
+	@brief Stack push function
+
+	Moves value to the top of the stack.
+
+	@param value the item to push
+
+	@throw std::overflow_error the stack is full and G does not grow it
+
+	@post _top = top + 1 */
+	void push(T&& value) {
+		if (isFull()) {
+			T moved(std::move(value));
+			grow(_size + 1);
+			construct_top(std::move(moved));
 		}
+		else
+			construct_top(std::move(value));
+	}
+
+	/**
+	@brief Stack emplace function
+
+	Constructs an element in place on the top of the stack.
+
+	@param args arguments of the constructor of T
+
+	@return reference to the new top element
+
+	@throw std::overflow_error the stack is full and G does not grow it
+
+	@post _top = top + 1 */
+	template <typename... Args>
+	T& emplace(Args&&... args) {
+		if (isFull()) {
+			T value(std::forward<Args>(args)...);
+			grow(_size + 1);
+			return construct_top(std::move(value));
+		}
+		return construct_top(std::forward<Args>(args)...);
+	}
+
+	/**
+	@brief Pushes the elements of [first, last), the last one ends on top.
+
+	The capacity is checked, and grown as the policy G says, once for the
+	whole range; the elements are then copied in a single pass (memcpy for
+	trivially copyable T). With forward iterators either all the elements
+	are pushed or, if an exception is thrown, none. The range must not refer
+	to elements of this stack.
+
+	@param first iterator to the first element to push
+	@param last iterator after the last element to push
+
+	@throw std::overflow_error the elements do not fit and G does not grow the stack
+
+	@post _top = top + std::distance(first, last) */
+	template<class I>
+	void push_range(I first, I last) {
+		typedef typename std::iterator_traits<I>::iterator_category category;
+		if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+			size_type n = size_type(std::distance(first, last));
+			if (n > _size - size_type(getActualSize()))
+				grow(size_type(getActualSize()) + n);
+			TRACE_EVENT("stack", "stack::push_range(I, I)");
+			TRACE_COUNT("stack", accesses, n);
+			std::uninitialized_copy(first, last, _DataPointer + _top + 1);
+			_top += int(n);
+		}
+		else {
+			for (; first != last; ++first)
+				push(*first);
+		}
+	}
+
+	/**
+	@brief Removes the top n elements and moves them to out.
+
+	The elements are written in stack order, from the deepest of the n to
+	the top one, so push_range on what pop_n wrote restores the stack. For
+	trivially copyable T and a pointer destination this is a single memmove.
+
+	@param n number of elements to remove
+	@param out iterator to the destination
+
+	@return the iterator after the last element written
+
+	@throw std::underflow_error the stack holds fewer than n elements
+
+	@post _top = top - n */
+	template<class O>
+	O pop_n(size_type n, O out) {
+		if (n > size_type(getActualSize()))
+			throw std::underflow_error("stack holds fewer elements than requested!");
+		TRACE_EVENT("stack", "stack::pop_n(size_type, O)");
+		TRACE_COUNT("stack", accesses, n);
+		T* first = _DataPointer + getActualSize() - n;
+		out = std::move(first, _DataPointer + getActualSize(), out);
+		destroy(first, n);
+		_top -= int(n);
+		drop_checkpoints();
+		shrink();
+		return out;
 	}
 
 	/**
 	@brief Stack pop function
 
 	Extracts the top element of type T from the stack, if it isn't empty.
+	The element is moved out of the stack, not copied.
 	Throws underflow error if stack is empty.
 
 	@post _top = top - 1 */
@@ -189,10 +347,38 @@ public:
 			exit(EXIT_FAILURE);
 		}
 		else {
-			std::cout << "REMOVING  " << _DataPointer[_top] << " FROM STACK" << std::endl;
+			TRACE_EVENT("stack", "stack::pop()");
+			TRACE_COUNT("stack", accesses, 1);
 		}
 
-		return _DataPointer[_top--];
+		T value(std::move(_DataPointer[_top]));
+		_DataPointer[_top--].~T();
+		drop_checkpoints();
+		shrink();
+		return value;
+	}
+
+	/**
+	@brief Stack pop function
+
+	Moves the top element into out and removes it from the stack. Unlike
+	pop() it needs no temporary, so out can reuse its own resources.
+
+	@param out destination of the top element
+
+	@throw std::underflow_error the stack is empty
+
+	@post _top = top - 1 */
+	void pop_into(T& out) {
+		assert(!isEmpty());
+		if (isEmpty())
+			throw std::underflow_error("stack is empty!");
+		TRACE_EVENT("stack", "stack::pop_into(T &)");
+		TRACE_COUNT("stack", accesses, 1);
+		out = std::move(_DataPointer[_top]);
+		_DataPointer[_top--].~T();
+		drop_checkpoints();
+		shrink();
 	}
 
 	/**
@@ -220,9 +406,80 @@ public:
 
 	void empty() {
 		if (isEmpty())
-			std::cout << "stack is already empty!" << std::endl;
-		else
+			TRACE_EVENT("stack", "stack::empty() on an empty stack");
+		else {
+			destroy(_DataPointer, getActualSize());
 			_top = -1;
+			drop_checkpoints();
+			shrink();
+		}
+	}
+
+	/**
+	@brief Saves the current depth of the stack.
+
+	Checkpoints nest: rolling back to one invalidates the checkpoints taken
+	after it, while the ones taken before stay usable. A checkpoint is also
+	invalidated when a pop, pop_n or empty() takes the stack below its depth,
+	even if the stack grows back later.
+
+	@return the token to pass to rollback()
+	 */
+	checkpoint_token checkpoint() {
+		checkpoint_token token = { size_type(getActualSize()), ++_serial };
+		_checkpoints.push_back(token);
+		return token;
+	}
+
+	/**
+	@brief Removes in one step every element pushed after the checkpoint.
+
+	The elements are destroyed from the top down; for trivially destructible
+	T this costs O(1) whatever their number. The capacity is not reduced,
+	whatever the policy G: call shrink_to_fit() to give memory back.
+
+	@param token checkpoint returned by checkpoint()
+
+	@throw std::invalid_argument the checkpoint is no longer valid (see checkpoint())
+
+	@post getActualSize() == token.depth
+	 */
+	void rollback(checkpoint_token token) {
+		typename std::vector<checkpoint_token>::size_type i = _checkpoints.size();
+		while (i > 0 && _checkpoints[i - 1].serial > token.serial)
+			i--;
+		if (i == 0 || _checkpoints[i - 1].serial != token.serial)
+			throw std::invalid_argument("checkpoint no longer valid!");
+		_checkpoints.resize(i); // the checkpoints taken after token are gone
+
+		TRACE_EVENT("stack", "stack::rollback(checkpoint_token)");
+		size_type n = size_type(getActualSize()) - token.depth;
+		if (!std::is_trivially_destructible<T>::value)
+			for (size_type i = n; i > 0; i--)
+				_DataPointer[token.depth + i - 1].~T();
+		_top = int(token.depth) - 1;
+	}
+
+	/**
+	@brief Reserves storage for at least n elements.
+
+	@param n capacity requested
+
+	@post getSize() >= n
+	 */
+	void reserve(size_type n) {
+		if (n > _size)
+			reallocate(n);
+	}
+
+	/**
+	@brief Reduces the capacity to the number of elements.
+
+	@post getSize() == getActualSize()
+	 */
+	void shrink_to_fit() {
+		if (_size > size_type(getActualSize()))
+			reallocate(getActualSize());
 	}
 
 	/**
@@ -251,24 +508,23 @@ public:
 	@post _size = other._size
 	@post _top = other._top
   */
-	stack(const stack& other) : _DataPointer(nullptr), _size(0), _top(-1) {
-		_DataPointer = new T[other._size];
+	stack(const stack& other) : _DataPointer(nullptr), _size(0), _top(-1),
+		_checkpoints(other._checkpoints), _serial(other._serial) {
+		_DataPointer = allocate(other._size);
 		_size = other._size;
-		_top = other._top;
 		try {
-			for (size_type i = 0; i < other.getActualSize(); i++) //more computational
-				this->_DataPointer[i] = other._DataPointer[i];
+			std::uninitialized_copy(other._DataPointer, other._DataPointer + other.getActualSize(), _DataPointer);
+			_top = other._top;
 		}
 		catch (...) {
-			delete[] _DataPointer;
+			deallocate(_DataPointer);
 			_DataPointer = nullptr;
 			_size = 0;
 			_top = -1;
 			throw; // rilancio dell'eccezione !!
 		}
-	#ifndef NDEBUG
-		std::cout << "stack::stack(const stack &)" << std::endl;
-	#endif
+		TRACE_EVENT("stack", "stack::stack(const stack &)");
+		TRACE_COUNT("stack", copies, 1);
 	}
 /*
 	@brief swap stack method
@@ -278,6 +534,8 @@ public:
 		std::swap(this->_DataPointer, other._DataPointer);
 		std::swap(this->_size, other._size);
 		std::swap(this->_top, other._top);
+		this->_checkpoints.swap(other._checkpoints);
+		std::swap(this->_serial, other._serial);
 	}
 
 	/**
@@ -302,9 +560,7 @@ public:
 			this->swap(tmp);
 		}
 
-	#ifndef NDEBUG
-		std::cout << "stack::operator=(const stack &)" << std::endl;
-	#endif
+		TRACE_EVENT("stack", "stack::operator=(const stack &)");
 
 		return *this;
 	}
@@ -323,9 +579,7 @@ public:
 		for (size_type i = 0; i < getActualSize(); i++)
 			if (this->_DataPointer[i] != other.getPointer()[i])
 				return false;
-	#ifndef NDEBUG
-		std::cout << "stack::operator==(const stack &)" << std::endl;
-	#endif
+		TRACE_EVENT("stack", "stack::operator==(const stack &)");
 		return true;
 	}
 
@@ -338,9 +592,9 @@ public:
 
 		@return reference to output stream
 		*/
-		friend std::ostream & operator<<(std::ostream & os, const stack<T>&m) {
+		friend std::ostream & operator<<(std::ostream & os, const stack&m) {
 		os << "size: " << m.getSize() << std::endl;
-		for (typename stack<T>::size_type i = 0; i < m.getActualSize(); i++) {
+		for (size_type i = 0; i < m.getActualSize(); i++) {
 			os << m.getValue(i) << " ";
 			}
 		os << std::endl;
@@ -506,6 +760,120 @@ private:
 	T* _DataPointer; //points to the head of the stack.
 	size_type _size;  //dimesion of the stack.
 	int _top;  // targets the top element, the one to push or pop.
+	std::vector<checkpoint_token> _checkpoints;  // valid checkpoints, oldest first
+	unsigned long long _serial = 0;  // serial of the last checkpoint
+
+	/**
+	@brief Forgets the checkpoints left above the top by a removal.
+	*/
+	void drop_checkpoints() {
+		while (!_checkpoints.empty() && _checkpoints.back().depth > size_type(getActualSize()))
+			_checkpoints.pop_back();
+	}
+
+	/**
+	@brief Constructs the element above _top, which must be free, and makes it the top.
+	*/
+	template <typename... Args>
+	T& construct_top(Args&&... args) {
+		TRACE_EVENT("stack", "stack::push(T)");
+		TRACE_COUNT("stack", accesses, 1);
+		T* p = new (_DataPointer + _top + 1) T(std::forward<Args>(args)...);
+		++_top;
+		return *p;
+	}
+
+	/**
+	@brief Uninitialized storage for n elements, nullptr if n is zero.
+	*/
+	static T* allocate(size_type n) {
+		if (n == 0)
+			return nullptr;
+		TRACE_COUNT("stack", allocations, 1);
+		TRACE_COUNT("stack", bytes, n * sizeof(T));
+		if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			return static_cast<T*>(::operator new(std::size_t(n) * sizeof(T), std::align_val_t(alignof(T))));
+		else
+			return static_cast<T*>(::operator new(std::size_t(n) * sizeof(T)));
+	}
+
+	static void deallocate(T* p) {
+		if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			::operator delete(p, std::align_val_t(alignof(T)));
+		else
+			::operator delete(p);
+	}
+
+	static void destroy(T* p, size_type n) {
+		if (!std::is_trivially_destructible<T>::value)
+			for (size_type i = 0; i < n; i++)
+				p[i].~T();
+	}
+
+	/**
+	@brief Relocates the elements to a new buffer of the given capacity.
+
+	Trivially copyable elements are copied with memcpy, the others are moved
+	(copied if their move constructor may throw) and then destroyed. If an
+	exception is thrown the stack is left unchanged.
+	*/
+	void reallocate(size_type capacity) {
+		size_type n = getActualSize();
+		T* p = allocate(capacity);
+		if (std::is_trivially_copyable<T>::value) {
+			if (n > 0)
+				std::memcpy(static_cast<void*>(p), _DataPointer, n * sizeof(T));
+		}
+		else {
+			size_type i = 0;
+			try {
+				for (; i < n; i++)
+					new (p + i) T(std::move_if_noexcept(_DataPointer[i]));
+			}
+			catch (...) {
+				destroy(p, i);
+				deallocate(p);
+				throw;
+			}
+			destroy(_DataPointer, n);
+		}
+		deallocate(_DataPointer);
+		_DataPointer = p;
+		_size = capacity;
+	}
+
+	/**
+	@brief Grows the capacity, as the policy G says, until it is at least needed.
+
+	@throw std::overflow_error G refuses to grow the stack
+	*/
+	void grow(size_type needed) {
+		size_type capacity = _size;
+		while (capacity < needed) {
+			size_type next = G::grow(capacity);
+			if (next == 0)
+				throw std::overflow_error("stack is full!");
+			if (next <= capacity)
+				throw std::length_error("stack capacity overflow!");
+			capacity = next;
+		}
+		reallocate(capacity);
+	}
+
+	/**
+	@brief Gives memory back after a removal if the policy G says so.
+	A failed reallocation keeps the larger buffer.
+	*/
+	void shrink() {
+		size_type capacity = G::shrink(_size, getActualSize());
+		if (capacity < _size && capacity >= size_type(getActualSize())) {
+			try {
+				reallocate(capacity);
+			}
+			catch (...) {
+			}
+		}
+	}
 };
 
 #endif
\ No newline at end of file
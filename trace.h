@@ -0,0 +1,199 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+  @file trace.h
+  @brief instrumentation of the containers (counters and trace events)
+
+  The containers call TRACE_EVENT and TRACE_COUNT where they used to print
+  to std::cout. Without CONTAINERS_TRACE defined both macros expand to
+  nothing, so the release builds pay nothing. With -DCONTAINERS_TRACE:
+
+  - TRACE_COUNT(container, counter, n) adds n to a per-container counter
+    (constructions, copies, allocations, bytes, accesses);
+  - TRACE_EVENT(container, name) records a timestamped event in a ring buffer
+    owned by the calling thread, written without locks;
+  - trace::dump_chrome_json(os) writes the events and the counters in the
+    Chrome trace format (chrome://tracing, Perfetto).
+*/
+
+#ifdef CONTAINERS_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+	/**
+	@brief Counters of one kind of container.
+	*/
+	struct counters {
+		const char* name;
+		std::atomic<std::uint64_t> constructions;
+		std::atomic<std::uint64_t> copies;
+		std::atomic<std::uint64_t> allocations;
+		std::atomic<std::uint64_t> bytes;
+		std::atomic<std::uint64_t> accesses;
+
+		explicit counters(const char* n) : name(n), constructions(0), copies(0), allocations(0), bytes(0), accesses(0) {}
+	};
+
+	/**
+	@brief An event of a ring buffer.
+	*/
+	struct event {
+		const char* container;
+		const char* name;
+		std::uint64_t ns; // nanoseconds since the first use of the layer
+	};
+
+	/**
+	@brief Ring buffer of the events of one thread. Only the owner thread
+	writes it; head is published with release ordering for the dump.
+	*/
+	struct ring {
+		static constexpr std::size_t capacity = std::size_t(1) << 16;
+		unsigned int tid;
+		std::atomic<std::uint64_t> head; // number of events written so far
+		std::unique_ptr<event[]> events;
+
+		explicit ring(unsigned int t) : tid(t), head(0), events(new event[capacity]) {}
+	};
+
+	/**
+	@brief Global state: counters and ring buffers, kept alive until exit so
+	that the events of finished threads can still be dumped.
+	*/
+	struct registry {
+		std::mutex lock; // taken only to register a container or a thread
+		std::vector<std::unique_ptr<counters> > all_counters;
+		std::vector<std::shared_ptr<ring> > rings;
+		std::chrono::steady_clock::time_point start;
+
+		registry() : start(std::chrono::steady_clock::now()) {}
+	};
+
+	inline registry& global() {
+		static registry r;
+		return r;
+	}
+
+	inline std::uint64_t now_ns() {
+		return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - global().start).count());
+	}
+
+	/**
+	@brief Counters of a container, created on first use. Call sites cache
+	the reference in a static variable, see TRACE_COUNT.
+	*/
+	inline counters& counters_for(const char* container) {
+		registry& r = global();
+		std::lock_guard<std::mutex> guard(r.lock);
+		for (std::size_t i = 0; i < r.all_counters.size(); i++)
+			if (std::string(r.all_counters[i]->name) == container)
+				return *r.all_counters[i];
+		r.all_counters.emplace_back(new counters(container));
+		return *r.all_counters.back();
+	}
+
+	inline ring& thread_ring() {
+		thread_local std::shared_ptr<ring> mine;
+		if (!mine) {
+			registry& r = global();
+			std::lock_guard<std::mutex> guard(r.lock);
+			mine = std::make_shared<ring>(unsigned(r.rings.size()));
+			r.rings.push_back(mine);
+		}
+		return *mine;
+	}
+
+	/**
+	@brief Records an event in the ring buffer of the calling thread.
+	*/
+	inline void record(const char* container, const char* name) {
+		ring& b = thread_ring();
+		std::uint64_t h = b.head.load(std::memory_order_relaxed);
+		event& e = b.events[h % ring::capacity];
+		e.container = container;
+		e.name = name;
+		e.ns = now_ns();
+		b.head.store(h + 1, std::memory_order_release);
+	}
+
+	inline void write_escaped(std::ostream& os, const char* s) {
+		for (; *s; s++) {
+			if (*s == '"' || *s == '\\')
+				os << '\\';
+			os << *s;
+		}
+	}
+
+	/**
+	@brief Writes the recorded events (the last ring::capacity of every
+	thread) and the counters as Chrome trace JSON. Events recorded while the
+	dump runs may be missing or torn, so dump when the threads are quiet.
+
+	@param os output stream
+	*/
+	inline void dump_chrome_json(std::ostream& os) {
+		registry& r = global();
+		std::lock_guard<std::mutex> guard(r.lock);
+		bool first = true;
+		os << "{\"traceEvents\":[\n";
+		for (std::size_t t = 0; t < r.rings.size(); t++) {
+			const ring& b = *r.rings[t];
+			std::uint64_t head = b.head.load(std::memory_order_acquire);
+			std::uint64_t begin = head > ring::capacity ? head - ring::capacity : 0;
+			for (std::uint64_t i = begin; i < head; i++) {
+				const event& e = b.events[i % ring::capacity];
+				os << (first ? "" : ",\n") << "{\"name\":\"";
+				write_escaped(os, e.name);
+				os << "\",\"cat\":\"";
+				write_escaped(os, e.container);
+				os << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":" << b.tid
+					<< ",\"ts\":" << double(e.ns) / 1000.0 << "}";
+				first = false;
+			}
+		}
+		double ts = double(now_ns()) / 1000.0;
+		for (std::size_t c = 0; c < r.all_counters.size(); c++) {
+			const counters& k = *r.all_counters[c];
+			os << (first ? "" : ",\n") << "{\"name\":\"";
+			write_escaped(os, k.name);
+			os << "\",\"ph\":\"C\",\"pid\":0,\"ts\":" << ts << ",\"args\":{"
+				<< "\"constructions\":" << k.constructions.load()
+				<< ",\"copies\":" << k.copies.load()
+				<< ",\"allocations\":" << k.allocations.load()
+				<< ",\"bytes\":" << k.bytes.load()
+				<< ",\"accesses\":" << k.accesses.load() << "}}";
+			first = false;
+		}
+		os << "\n]}\n";
+	}
+
+} // namespace trace
+
+#define TRACE_EVENT(container, name) ::trace::record(container, name)
+
+#define TRACE_COUNT(container, counter, n) \
+	do { \
+		static ::trace::counters& trace_counters_ = ::trace::counters_for(container); \
+		trace_counters_.counter.fetch_add(std::uint64_t(n), std::memory_order_relaxed); \
+	} while (0)
+
+#else
+
+#define TRACE_EVENT(container, name) ((void)0)
+#define TRACE_COUNT(container, counter, n) ((void)0)
+
+#endif // CONTAINERS_TRACE
+
+#endif // !TRACE_H
@@ -0,0 +1,177 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstddef> // std::size_t
+#include <cstdint> // std::int64_t
+#include <memory> // std::unique_ptr
+#include <type_traits> // std::is_trivially_copyable
+#include <vector>
+
+/**
+  @file work_stealing_deque.h
+  @brief Chase-Lev work-stealing deque
+*/
+
+/**
+  @brief Classe work_stealing_deque
+
+  Deque of tasks owned by one thread. The owner pushes and pops at the
+  bottom, like the _top of stack, while any other thread steals from the
+  other end without locks. Owner operations touch only the bottom index
+  unless the deque is down to its last element, so the owner pays no
+  atomic read-modify-write in the common case.
+
+  The elements live in a circular buffer whose capacity is a power of two.
+  When it is full the owner copies the live elements to a buffer twice as
+  large; the old buffers are kept until the deque is destroyed, because a
+  thief may still be reading from them.
+
+  Memory ordering follows Le, Pop, Cohen, Zappa Nardelli, "Correct and
+  efficient work-stealing for weak memory models" (PPoPP 2013).
+*/
+template <typename T>
+class work_stealing_deque {
+public:
+	static_assert(std::is_trivially_copyable<T>::value, "work_stealing_deque needs a trivially copyable T");
+
+	typedef std::size_t size_type;
+
+	/**
+	@brief Constructor
+
+	@param capacity initial capacity, rounded up to a power of two
+	*/
+	explicit work_stealing_deque(size_type capacity = 64) : _top(0), _bottom(0) {
+		size_type c = 1;
+		while (c < capacity)
+			c *= 2;
+		_buffers.emplace_back(new buffer(c));
+		_array.store(_buffers.back().get(), std::memory_order_relaxed);
+	}
+
+	work_stealing_deque(const work_stealing_deque&) = delete;
+	work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+	/**
+	@brief Pushes value at the bottom. Owner thread only.
+
+	@param value the item to push
+	*/
+	void push(const T& value) {
+		std::int64_t b = _bottom.load(std::memory_order_relaxed);
+		std::int64_t t = _top.load(std::memory_order_acquire);
+		buffer* a = _array.load(std::memory_order_relaxed);
+		if (b - t > std::int64_t(a->capacity) - 1)
+			a = grow(a, t, b);
+		a->put(b, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		_bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	/**
+	@brief Pops the element at the bottom, the last pushed. Owner thread only.
+
+	@param out receives the element
+	@return true if an element was removed, false if the deque was empty
+	*/
+	bool try_pop(T& out) {
+		std::int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+		buffer* a = _array.load(std::memory_order_relaxed);
+		_bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::int64_t t = _top.load(std::memory_order_relaxed);
+		if (t > b) { // empty
+			_bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		T value = a->get(b);
+		if (t == b) { // last element: race against the thieves on _top
+			bool won = _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			_bottom.store(b + 1, std::memory_order_relaxed);
+			if (!won)
+				return false;
+		}
+		out = value;
+		return true;
+	}
+
+	/**
+	@brief Steals the element at the top, the oldest. Any thread.
+
+	A steal can fail because another thief, or the owner, took the same
+	element first: false does not always mean the deque is empty.
+
+	@param out receives the element
+	@return true if an element was stolen
+	*/
+	bool try_steal(T& out) {
+		std::int64_t t = _top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::int64_t b = _bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return false;
+		buffer* a = _array.load(std::memory_order_acquire);
+		T value = a->get(t);
+		if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return false;
+		out = value;
+		return true;
+	}
+
+	/**
+	@brief Number of elements, exact only when no other thread is using the deque.
+	*/
+	size_type size_approx() const {
+		std::int64_t n = _bottom.load(std::memory_order_relaxed) - _top.load(std::memory_order_relaxed);
+		return n < 0 ? 0 : size_type(n);
+	}
+
+	/**
+	@brief Capacity of the current buffer.
+	*/
+	size_type capacity() const {
+		return _array.load(std::memory_order_relaxed)->capacity;
+	}
+
+private:
+	/**
+	@brief Circular buffer; index i is stored at i % capacity. The elements
+	are atomics because a thief may read one while the owner overwrites it
+	(the thief then loses the CAS on _top and discards what it read).
+	*/
+	struct buffer {
+		size_type capacity;
+		std::unique_ptr<std::atomic<T>[]> items;
+
+		explicit buffer(size_type c) : capacity(c), items(new std::atomic<T>[c]) {}
+
+		T get(std::int64_t i) const {
+			return items[size_type(i) & (capacity - 1)].load(std::memory_order_relaxed);
+		}
+
+		void put(std::int64_t i, const T& value) {
+			items[size_type(i) & (capacity - 1)].store(value, std::memory_order_relaxed);
+		}
+	};
+
+	alignas(64) std::atomic<std::int64_t> _top; // next element to steal
+	alignas(64) std::atomic<std::int64_t> _bottom; // next free slot of the owner
+	std::atomic<buffer*> _array;
+	std::vector<std::unique_ptr<buffer> > _buffers; // current and retired buffers, owner only
+
+	/**
+	@brief Copies the elements in [t, b) to a buffer of twice the capacity
+	and publishes it.
+	*/
+	buffer* grow(buffer* a, std::int64_t t, std::int64_t b) {
+		_buffers.emplace_back(new buffer(a->capacity * 2));
+		buffer* bigger = _buffers.back().get();
+		for (std::int64_t i = t; i < b; i++)
+			bigger->put(i, a->get(i));
+		_array.store(bigger, std::memory_order_release);
+		return bigger;
+	}
+}; //END CLASS work_stealing_deque
+
+#endif // !WORK_STEALING_DEQUE_H